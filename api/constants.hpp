@@ -10,7 +10,10 @@
 // #define MEMORY_CACHE    1 * 1024 * 1024 * 1024    // 1GB memory for block cache
 #define MEMORY_CACHE    5LL * 1024 * 1024 * 1024    // 8GB memory for block cache
 
-#define MAX_TWALKS  4 * 1024              // one thread at most 4096 walks in memory
-#define MAX_BWALKS  12 * MAX_TWALKS       // one block at most has 12 * 4096 walks in memory
+#define MAX_TWALKS  4 * 1024              // one thread at most 4096 walks of a block pair in memory, the default of `twalks`
+#define MAX_BWALKS  64 * MAX_TWALKS       // one thread at most walks 64 * 4096 walks in a batch, the default of `bwalks`
+#define MAX_TRECORDS 1024 * 1024          // one thread at most buffers 1M trajectory records in memory
+#define WALK_SORT_MIN 64 * 1024           // the walk batches of fewer walks are not reordered, they fit into the cpu cache
+#define DEFAULT_SEED 20220401             // the seed of the sampled start vertices when `seed` is not given, so the runs repeat
 
 #endif
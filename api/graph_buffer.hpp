@@ -3,6 +3,8 @@
 
 #include <assert.h>
 #include <cstddef>
+#include <utility>
+#include "util/hugepage.hpp"
 /** This file defines the buffer data structure used in graph processing */
 
 template<typename T>
@@ -25,7 +27,7 @@ public:
     void alloc(size_t size) { 
         this->capacity = size;
         this->bsize = 0;
-        this->array = (T*)malloc(size * sizeof(T));
+        this->array = (T*)hugepage_alloc(size * sizeof(T));
     }
 
     void realloc(size_t size) {
@@ -35,7 +37,7 @@ public:
     }
 
     void destroy() { 
-        if(this->array) free(this->array);
+        if(this->array) hugepage_free(this->array);
         this->array = NULL;
         this->bsize = 0;
         this->capacity = 0;
@@ -72,6 +74,13 @@ public:
     void set_size(size_t _size) {
         this->bsize = _size;
     }
+
+    /** exchange the storage with another buffer, no element is copied */
+    void swap(graph_buffer<T> &other) {
+        std::swap(this->bsize, other.bsize);
+        std::swap(this->capacity, other.capacity);
+        std::swap(this->array, other.array);
+    }
 };
 
 #endif
\ No newline at end of file
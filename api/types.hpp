@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <functional>
+#include <type_traits>
 
 typedef uint32_t vid_t;   /* vertex id */
 typedef uint64_t eid_t;   /* edge id */
@@ -10,65 +11,141 @@ typedef uint32_t bid_t;   /* block id */
 typedef uint32_t rank_t;  /* block rank */
 typedef uint16_t hid_t;   /* walk hop */
 typedef uint16_t tid_t;   /* thread id */
-typedef uint32_t wid_t;   /* walk id */
 typedef uint64_t walk_t;  /* walker data type */
 typedef float    real_t;     /* edge weight */
 
-#define HOP_SIZE 8           /* hop field size */
-#define VERTEX_SIZE 28      /* source, previous, current vertex size */
-#define WALKER_ID_SIZE 36   /* walker id size */
-
 enum WeightType { UNWEIGHTED, WEIGHTED };
 
-// struct walker_t {
-//     uint64_t data[2];
-//     walker_t() {
-//         data[0] = data[1] = 0;
-//     }
-// };
-
-// #define WALKER_ID(walk) (walk.data[0] >> VERTEX_SIZE)
-// #define WALKER_SOURCE(walk) (walk.data[0] & ((0x1 << VERTEX_SIZE) - 1))
-// #define WALKER_PREVIOUS(walk) (walk.data[1] >> (VERTEX_SIZE + HOP_SIZE))
-// #define WALKER_POS(walk) ((walk.data[1] >> HOP_SIZE) & ((0x1LL << VERTEX_SIZE) - 1))
-// #define WALKER_HOP(walk) (walk.data[1] & ((0x1 << HOP_SIZE) - 1))
-
-// walker_t walker_makeup(wid_t id, vid_t source, vid_t previous, vid_t pos, hid_t hop)
-// {
-//     walker_t walk_data;
-//     walk_data.data[0] |= source & ((0x1LL << VERTEX_SIZE) - 1);
-//     walk_data.data[0] |= static_cast<long long>(id & ((0x1LL << WALKER_ID_SIZE) - 1)) << VERTEX_SIZE;
-//     walk_data.data[1] |= hop & ((0x1 << HOP_SIZE) - 1);
-//     walk_data.data[1] |= static_cast<long long>(pos & ((0x1LL << VERTEX_SIZE) - 1)) << HOP_SIZE;
-//     walk_data.data[1] |= static_cast<long long>(previous & ((0x1LL << VERTEX_SIZE) - 1)) << (HOP_SIZE + VERTEX_SIZE);
-//     return walk_data;
-// }
+/**
+ * The walker is packed into `WALKER_WORDS` 64-bit words, the bit width of each field is chosen at startup from the
+ * number of vertices and hops, and the walk id takes the remaining bits:
+ *
+ * | current | previous | source (vertex bits each) | hop (hop bits) | id (the rest, at most the bits of wid_t) |
+ *
+ * The block indexes are not stored, they are derived from the current and previous vertex. 16 bytes hold the walks of
+ * graphs with up to 2^28 vertices and 255 hops with 32-bit walk ids, build with `WIDE_WALK_ID` for 64-bit walk ids,
+ * the walker takes 24 bytes then.
+ */
+
+#ifdef WIDE_WALK_ID
+typedef uint64_t wid_t;   /* walk id */
+#define WALKER_WORDS 3
+#else
+typedef uint32_t wid_t;   /* walk id */
+#define WALKER_WORDS 2
+#endif
+
+/**
+ * An app keeps its per walk state (e.g. a restart flag, a score or a metapath position) in the walker by defining
+ * `WALKER_PAYLOAD` as a trivially copyable type before including any header, or with `-D WALKER_PAYLOAD=<type>`.
+ * The payload follows the fields in the buckets, the walk files and the checkpoint, and the walker is padded to
+ * 8 bytes. Without it the walker has no payload and takes no byte for it.
+ */
+#ifdef WALKER_PAYLOAD
+typedef WALKER_PAYLOAD walker_payload_t;
+
+struct walker_t {
+    uint64_t data[WALKER_WORDS];
+    walker_payload_t payload;
+};
 
+static_assert(std::is_trivially_copyable<walker_payload_t>::value, "the walker payload is copied as bytes");
+static_assert(sizeof(walker_t) < 256, "the walker layout code keeps the walker size in 8 bits");
+#else
 struct walker_t {
-    wid_t id;
-    vid_t source, previous, current;
-    bid_t hop;
-    bid_t cur_index, prev_index;
+    uint64_t data[WALKER_WORDS];
+};
+#endif
+
+/* the next walker of a walk keeps the payload of `from` */
+inline void walker_carry(walker_t &to, const walker_t &from) {
+#ifdef WALKER_PAYLOAD
+    to.payload = from.payload;
+#endif
+}
+
+struct walker_layout_t {
+    unsigned vertex_bits, hop_bits, id_bits;
+    unsigned previous_off, source_off, hop_off, id_off;
+    uint64_t vertex_mask, hop_mask, id_mask;
+
+    static unsigned bit_width(uint64_t val) {
+        unsigned bits = 1;
+        while(bits < 64 && (val >> bits) != 0) bits++;
+        return bits;
+    }
+
+    static uint64_t bit_mask(unsigned bits) { return bits >= 64 ? ~0ULL : (1ULL << bits) - 1; }
+
+    /* fit the fields of a graph with `nvertices` vertices and walks of `hops` hops, false if the vertices and hops leave no bit for the id */
+    bool setup(uint64_t nvertices, uint64_t hops) {
+        vertex_bits = bit_width(nvertices > 0 ? nvertices - 1 : 0);
+        hop_bits = bit_width(hops);
+        unsigned used = 3 * vertex_bits + hop_bits;
+        if(used >= 64 * WALKER_WORDS) return false;
+        id_bits = 64 * WALKER_WORDS - used;
+        if(id_bits > 8 * sizeof(wid_t)) id_bits = 8 * sizeof(wid_t);
+        previous_off = vertex_bits;
+        source_off = 2 * vertex_bits;
+        hop_off = 3 * vertex_bits;
+        id_off = hop_off + hop_bits;
+        vertex_mask = bit_mask(vertex_bits);
+        hop_mask = bit_mask(hop_bits);
+        id_mask = bit_mask(id_bits);
+        return true;
+    }
+
+    /* a compact code of the field widths, walkers of two runs are interchangeable if the codes are equal */
+    uint32_t code() const { return vertex_bits | hop_bits << 8 | id_bits << 16 | (uint32_t)sizeof(walker_t) << 24; }
 };
 
-#define WALKER_ID(walk) (walk.id)
-#define WALKER_SOURCE(walk) (walk.source)
-#define WALKER_PREVIOUS(walk) (walk.previous)
-#define WALKER_POS(walk) (walk.current)
-#define WALKER_HOP(walk) (walk.hop)
-#define WALKER_CUR_BLOCK(walk) (walk.cur_index)
-#define WALKER_PREV_BLOCK(walk) (walk.prev_index)
+/* the default fits any vertex and 16-bit hops, the engine narrows it to the graph before the first walker */
+walker_layout_t make_default_walker_layout() {
+    walker_layout_t layout;
+    layout.setup(1ULL << 32, 0xffff);
+    return layout;
+}
+
+walker_layout_t walker_layout = make_default_walker_layout();
 
+/* the field of `width` bits at bit `off`, the field may cross a word boundary */
+inline uint64_t walker_field(const walker_t &walk, unsigned off, uint64_t mask) {
+    unsigned w = off >> 6, b = off & 63;
+    uint64_t val = walk.data[w] >> b;
+    if(w + 1 < WALKER_WORDS) val |= (walk.data[w + 1] << 1) << (63 - b);
+    return val & mask;
+}
+
+inline void walker_put(walker_t &walk, unsigned off, uint64_t val) {
+    unsigned w = off >> 6, b = off & 63;
+    walk.data[w] |= val << b;
+    if(w + 1 < WALKER_WORDS) walk.data[w + 1] |= (val >> 1) >> (63 - b);
+}
+
+/* the block of vertex `v`, defined along with the block index */
+bid_t walker_block(vid_t v);
+
+#define WALKER_ID(walk) (static_cast<wid_t>(walker_field(walk, walker_layout.id_off, walker_layout.id_mask)))
+#define WALKER_SOURCE(walk) (static_cast<vid_t>(walker_field(walk, walker_layout.source_off, walker_layout.vertex_mask)))
+#define WALKER_PREVIOUS(walk) (static_cast<vid_t>(walker_field(walk, walker_layout.previous_off, walker_layout.vertex_mask)))
+#define WALKER_POS(walk) (static_cast<vid_t>(walk.data[0] & walker_layout.vertex_mask))
+#define WALKER_HOP(walk) (static_cast<hid_t>(walker_field(walk, walker_layout.hop_off, walker_layout.hop_mask)))
+#define WALKER_CUR_BLOCK(walk) (walker_block(WALKER_POS(walk)))
+#define WALKER_PREV_BLOCK(walk) (walker_block(WALKER_PREVIOUS(walk)))
+
+/* `c_index` and `p_index` are the blocks of `pos` and `previous`, they are derived again when read */
 walker_t walker_makeup(wid_t id, vid_t source, vid_t previous, vid_t pos, hid_t hop, bid_t c_index, bid_t p_index)
 {
     walker_t walk_data;
-    walk_data.id = id;
-    walk_data.source = source;
-    walk_data.previous = previous;
-    walk_data.current = pos;
-    walk_data.hop = hop;
-    walk_data.cur_index = c_index;
-    walk_data.prev_index = p_index;
+    for(int w = 0; w < WALKER_WORDS; w++) walk_data.data[w] = 0;
+#ifdef WALKER_PAYLOAD
+    walk_data.payload = walker_payload_t();
+#endif
+    walk_data.data[0] = pos;
+    walker_put(walk_data, walker_layout.previous_off, previous);
+    walker_put(walk_data, walker_layout.source_off, source);
+    walker_put(walk_data, walker_layout.hop_off, hop);
+    walker_put(walk_data, walker_layout.id_off, id & walker_layout.id_mask);
     return walk_data;
 }
 
@@ -28,6 +28,11 @@ public:
         if(init_func) init_func(walk_manager);
     }
 
+    void prologue(graph_walk *walk_manager, walk_source *source)
+    {
+        walk_manager->set_source(source);
+    }
+
     virtual wid_t update_walk(const walker_t &walker, graph_cache *cache, graph_walk *walk_manager, RandNum* seed)
     {
         return 0;
@@ -63,25 +68,20 @@ public:
         vid_t cur_vertex = WALKER_POS(walker), prev_vertex = WALKER_PREVIOUS(walker);
         hid_t hop = WALKER_HOP(walker);
         bid_t cur_blk = WALKER_CUR_BLOCK(walker), prev_blk = WALKER_PREV_BLOCK(walker);
-        bid_t cur_cache_index = (*(walk_manager->global_blocks))[cur_blk].cache_index, prev_cache_index = (*(walk_manager->global_blocks))[prev_blk].cache_index;
-        bid_t nblocks = walk_manager->global_blocks->nblocks;
-        assert(cur_cache_index != nblocks && prev_cache_index != nblocks);
+        /* the walks of the uncached blocks only run in the tail mode, which reads their adjacency lists directly */
+        assert(cache->tail || (*(walk_manager->global_blocks))[cur_blk].cache_index != walk_manager->global_blocks->nblocks);
+        assert(cache->tail || (*(walk_manager->global_blocks))[prev_blk].cache_index != walk_manager->global_blocks->nblocks);
 
         wid_t run_step = 0;
-        while (cur_cache_index != nblocks && hop < this->_hops)
+        adj_list adj, prev_adj;
+        bool prev_ready = false;
+        if (hop == 0) walk_manager->record_step(WALKER_ID(walker), hop, cur_vertex);
+        /* the walk also steps through the hubs of the uncached blocks, the list of the current vertex is the previous list of the next step */
+        while (hop < this->_hops && cache->adjacency(cur_blk, cur_vertex, adj) && (prev_ready || cache->adjacency(prev_blk, prev_vertex, prev_adj)))
         {
-            cache_block *cur_block = &(cache->cache_blocks[cur_cache_index]);
-            cache_block *prev_block = &(cache->cache_blocks[prev_cache_index]);
-
-            vid_t start_vertex = cur_block->block->start_vert, off = cur_vertex - start_vertex;
-            vid_t prev_start_vertex = prev_block->block->start_vert, prev_off = prev_vertex - prev_start_vertex;
-
-            eid_t adj_head = cur_block->beg_pos[off] - cur_block->block->start_edge, adj_tail = cur_block->beg_pos[off + 1] - cur_block->block->start_edge;
-            eid_t prev_adj_head = prev_block->beg_pos[prev_off] - prev_block->block->start_edge, prev_adj_tail = prev_block->beg_pos[prev_off + 1] - prev_block->block->start_edge;
-
             vid_t next_vertex = 0;
+            eid_t deg = adj.size();
 
-            eid_t deg = adj_tail - adj_head;
             if (deg == 0)
                 next_vertex = seed->iRand(walk_manager->nvertices);
             else
@@ -100,12 +100,12 @@ public:
                         break;
                     }
 
-                    if (cur_block->csr[adj_head + rand_pos] == prev_vertex)
+                    if (adj[rand_pos] == prev_vertex)
                     {
                         if (rand_val < 1.0 / p)
                             accept = true;
                     }
-                    else if (std::binary_search(prev_block->csr + prev_adj_head, prev_block->csr + prev_adj_tail, cur_block->csr[adj_head + rand_pos]))
+                    else if (std::binary_search(prev_adj.begin(), prev_adj.end(), adj[rand_pos]))
                     {
                         if (rand_val < 1.0)
                             accept = true;
@@ -116,20 +116,22 @@ public:
                             accept = true;
                     }
                 }
-                next_vertex = cur_block->csr[adj_head + rand_pos];
+                next_vertex = adj[rand_pos];
             }
 
             prev_vertex = cur_vertex;
             cur_vertex = next_vertex;
             prev_blk = cur_blk;
+            prev_adj = adj;
+            prev_ready = true;
             hop++;
             run_step++;
+            walk_manager->record_step(WALKER_ID(walker), hop, cur_vertex);
 
-            prev_cache_index = cur_cache_index;
-            if (!(cur_vertex >= cur_block->block->start_vert && cur_vertex < cur_block->block->start_vert + cur_block->block->nverts))
+            const block_t &block = (*(walk_manager->global_blocks))[prev_blk];
+            if (!(cur_vertex >= block.start_vert && cur_vertex < block.start_vert + block.nverts))
             {
                 cur_blk = walk_manager->global_blocks->get_block(cur_vertex);
-                cur_cache_index = (*(walk_manager->global_blocks))[cur_blk].cache_index;
                 if (!continue_update)
                     break;
             }
@@ -138,6 +140,7 @@ public:
         if (hop < this->_hops)
         {
             walker_t next_walker = walker_makeup(WALKER_ID(walker), WALKER_SOURCE(walker), prev_vertex, cur_vertex, hop, cur_blk, prev_blk);
+            walker_carry(next_walker, walker);
             walk_manager->move_walk(next_walker);
         }
         return run_step;
@@ -165,36 +168,31 @@ public:
         vid_t cur_vertex = WALKER_POS(walker), prev_vertex = WALKER_PREVIOUS(walker);
         hid_t hop = WALKER_HOP(walker);
         bid_t cur_blk = WALKER_CUR_BLOCK(walker), prev_blk = WALKER_PREV_BLOCK(walker);
-        bid_t cur_cache_index = (*(walk_manager->global_blocks))[cur_blk].cache_index, prev_cache_index = (*(walk_manager->global_blocks))[prev_blk].cache_index;
-        bid_t nblocks = walk_manager->global_blocks->nblocks;
-        assert(cur_cache_index != nblocks && prev_cache_index != nblocks);
+        /* the walks of the uncached blocks only run in the tail mode, which reads their adjacency lists directly */
+        assert(cache->tail || (*(walk_manager->global_blocks))[cur_blk].cache_index != walk_manager->global_blocks->nblocks);
+        assert(cache->tail || (*(walk_manager->global_blocks))[prev_blk].cache_index != walk_manager->global_blocks->nblocks);
 
         wid_t run_step = 0;
-        while (cur_cache_index != nblocks && hop < this->_hops)
+        adj_list adj, prev_adj;
+        bool prev_ready = false;
+        if (hop == 0) walk_manager->record_step(WALKER_ID(walker), hop, cur_vertex);
+        /* the walk also steps through the hubs of the uncached blocks, the list of the current vertex is the previous list of the next step */
+        while (hop < this->_hops && cache->adjacency(cur_blk, cur_vertex, adj) && (prev_ready || cache->adjacency(prev_blk, prev_vertex, prev_adj)))
         {
-            cache_block *cur_block = &(cache->cache_blocks[cur_cache_index]);
-            cache_block *prev_block = &(cache->cache_blocks[prev_cache_index]);
-
-            vid_t start_vertex = cur_block->block->start_vert, off = cur_vertex - start_vertex;
-            vid_t prev_start_vertex = prev_block->block->start_vert, prev_off = prev_vertex - prev_start_vertex;
-
-            eid_t adj_head = cur_block->beg_pos[off] - cur_block->block->start_edge, adj_tail = cur_block->beg_pos[off + 1] - cur_block->block->start_edge;
-            eid_t prev_adj_head = prev_block->beg_pos[prev_off] - prev_block->block->start_edge, prev_adj_tail = prev_block->beg_pos[prev_off + 1] - prev_block->block->start_edge;
-
             vid_t next_vertex = 0;
+            eid_t deg = adj.size(), prev_deg = prev_adj.size();
 
-            eid_t deg = adj_tail - adj_head, prev_deg = prev_adj_tail - prev_adj_head;
             eid_t max_deg = std::max(deg, prev_deg);
             if (deg == 0) next_vertex = seed->iRand(walk_manager->nvertices);
             else
             {
                 std::vector<real_t> adj_weights(deg + 1, 0.0);
-                std::unordered_set<vid_t> prev_neighbors(prev_block->csr + prev_adj_head, prev_block->csr + prev_adj_tail);
+                std::unordered_set<vid_t> prev_neighbors(prev_adj.begin(), prev_adj.end());
                 for(size_t index = 0; index < deg; ++index) {
                     real_t wht = 0.0;
-                    if(cur_block->csr[adj_head + index] == prev_vertex) {
+                    if(adj[index] == prev_vertex) {
                         wht = (1.0 - alpha) / deg;
-                    }else if(prev_neighbors.find(cur_block->csr[adj_head + index]) != prev_neighbors.end()) {
+                    }else if(prev_neighbors.find(adj[index]) != prev_neighbors.end()) {
                         wht = (1.0 - alpha) / deg + alpha / prev_deg;
                     }else {
                         wht = (1.0 - alpha) / deg;
@@ -204,7 +202,7 @@ public:
 
                 real_t rand_val = seed->dRand() * adj_weights[deg];
                 size_t pos = std::upper_bound(adj_weights.begin(), adj_weights.end(), rand_val) - adj_weights.begin();
-                next_vertex = cur_block->csr[adj_head + pos - 1];
+                next_vertex = adj[pos - 1];
                 // std::unordered_set<vid_t> prev_neighbors(prev_block->csr + prev_adj_head, prev_block->csr + prev_adj_tail);
                 // if(prev_neighbors.size() == 0)  {
                 //     next_vertex = cur_block->csr[seed->iRand(static_cast<uint32_t>(deg))];
@@ -226,14 +224,16 @@ public:
             prev_vertex = cur_vertex;
             cur_vertex = next_vertex;
             prev_blk = cur_blk;
+            prev_adj = adj;
+            prev_ready = true;
             hop++;
             run_step++;
+            walk_manager->record_step(WALKER_ID(walker), hop, cur_vertex);
 
-            prev_cache_index = cur_cache_index;
-            if (!(cur_vertex >= cur_block->block->start_vert && cur_vertex < cur_block->block->start_vert + cur_block->block->nverts))
+            const block_t &block = (*(walk_manager->global_blocks))[prev_blk];
+            if (!(cur_vertex >= block.start_vert && cur_vertex < block.start_vert + block.nverts))
             {
                 cur_blk = walk_manager->global_blocks->get_block(cur_vertex);
-                cur_cache_index = (*(walk_manager->global_blocks))[cur_blk].cache_index;
                 if (!continue_update)
                     break;
             }
@@ -242,6 +242,7 @@ public:
         if (hop < this->_hops)
         {
             walker_t next_walker = walker_makeup(WALKER_ID(walker), WALKER_SOURCE(walker), prev_vertex, cur_vertex, hop, cur_blk, prev_blk);
+            walker_carry(next_walker, walker);
             walk_manager->move_walk(next_walker);
         }
         return run_step;
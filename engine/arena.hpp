@@ -0,0 +1,132 @@
+#ifndef _GRAPH_ARENA_H_
+#define _GRAPH_ARENA_H_
+
+#include <omp.h>
+#include <cstdlib>
+#include <cassert>
+#include "api/types.hpp"
+#include "util/hugepage.hpp"
+#include "util/timer.hpp"
+#include "util/bitpack.hpp"
+#include "logger/logger.hpp"
+
+/** block_arena
+ *
+ * This file contribute to define the memory arena of the cache blocks. The arena is reserved once at startup,
+ * it is cut into `nslots` slots, each slot holds aligned extents large enough for the beg_pos, csr and weights
+ * of the largest block:
+ *
+ * | beg_pos (max nverts + 1) | csr (max nedges) | weights (max nedges) | beg_pos | csr | weights | ...
+ *
+ * The extents are reused across the block swaps without reallocation, and the whole arena is pre-faulted in
+ * parallel, so loading a block into the cache is a pure I/O cost.
+ *
+ * For the bit packed blocks, a slot holds the per vertex record offsets and the packed records instead:
+ *
+ * | offsets (max nverts + 1) | records (max packed bytes) | offsets | records | ...
+ */
+
+#define ARENA_ALIGN 4096
+
+class block_arena {
+private:
+    char *base;
+
+    static size_t align(size_t bytes) { return (bytes + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN; }
+
+public:
+    bid_t nslots;
+    size_t beg_pos_bytes, csr_bytes, weight_bytes;  /* the extent size of each array */
+    size_t slot_bytes, total_bytes;
+    double prefault_time;                           /* the seconds to pre-fault the arena */
+
+    block_arena() : base(NULL), nslots(0), beg_pos_bytes(0), csr_bytes(0), weight_bytes(0), slot_bytes(0), total_bytes(0), prefault_time(0.0) { }
+
+    ~block_arena() {
+        if(base) hugepage_free(base);
+    }
+
+    /* the bytes of one slot for blocks with at most `max_nverts` vertices and `max_nedges` edges */
+    static size_t slot_size(vid_t max_nverts, eid_t max_nedges, bool weighted) {
+        size_t bytes = align((max_nverts + 1) * sizeof(eid_t)) + align(max_nedges * sizeof(vid_t));
+        if(weighted) bytes += align(max_nedges * sizeof(real_t));
+        return bytes;
+    }
+
+    void reserve(bid_t n, vid_t max_nverts, eid_t max_nedges, bool weighted) {
+        reserve_slots(n, align((max_nverts + 1) * sizeof(eid_t)), align(max_nedges * sizeof(vid_t)), weighted ? align(max_nedges * sizeof(real_t)) : 0);
+    }
+
+    void set_extents(bid_t n, size_t first_bytes, size_t second_bytes, size_t third_bytes) {
+        nslots = n;
+        beg_pos_bytes = first_bytes;
+        csr_bytes     = second_bytes;
+        weight_bytes  = third_bytes;
+        slot_bytes    = beg_pos_bytes + csr_bytes + weight_bytes;
+        total_bytes   = slot_bytes * nslots;
+    }
+
+    void reserve_slots(bid_t n, size_t first_bytes, size_t second_bytes, size_t third_bytes) {
+        assert(base == NULL);
+        set_extents(n, first_bytes, second_bytes, third_bytes);
+
+        if(huge_allocator.mode != HUGEPAGE_NONE && total_bytes >= HUGE_PAGE_SIZE) {
+            base = static_cast<char *>(hugepage_alloc(total_bytes));
+        } else if(posix_memalign(reinterpret_cast<void **>(&base), ARENA_ALIGN, total_bytes) != 0) {
+            base = NULL;
+        }
+        if(base == NULL) {
+            logstream(LOG_FATAL) << "can not reserve " << total_bytes << " bytes for the block arena" << std::endl;
+            assert(false);
+        }
+        logstream(LOG_INFO) << "block arena : " << nslots << " slots, " << slot_bytes << " bytes per slot, " << total_bytes << " bytes in total" << std::endl;
+    }
+
+    /* the bytes of one slot for bit packed blocks with at most `max_nverts` vertices and `max_packed` record bytes */
+    static size_t packed_slot_size(vid_t max_nverts, size_t max_packed) {
+        return align((max_nverts + 1) * sizeof(uint32_t)) + align(max_packed + BITPACK_PADDING);
+    }
+
+    void reserve_packed(bid_t n, vid_t max_nverts, size_t max_packed) {
+        reserve_slots(n, align((max_nverts + 1) * sizeof(uint32_t)), align(max_packed + BITPACK_PADDING), 0);
+    }
+
+    /* only set the slot layout, the slots live elsewhere, e.g. in the shared cache */
+    void layout(vid_t max_nverts, eid_t max_nedges, bool weighted) {
+        set_extents(0, align((max_nverts + 1) * sizeof(eid_t)), align(max_nedges * sizeof(vid_t)), weighted ? align(max_nedges * sizeof(real_t)) : 0);
+    }
+
+    void layout_packed(vid_t max_nverts, size_t max_packed) {
+        set_extents(0, align((max_nverts + 1) * sizeof(uint32_t)), align(max_packed + BITPACK_PADDING), 0);
+    }
+
+    /* touch every page of the arena, so that the block loads do not pay for the first-touch page faults */
+    void prefault(tid_t nthreads) {
+        graph_timer t;
+        t.start_time();
+        if(base == NULL) return;
+        size_t npages = (total_bytes + ARENA_ALIGN - 1) / ARENA_ALIGN;
+        #pragma omp parallel for schedule(static) num_threads(nthreads)
+        for(size_t page = 0; page < npages; page++) {
+            base[page * ARENA_ALIGN] = 0;
+        }
+        prefault_time = t.runtime();
+    }
+
+    char *slot(bid_t index) const { return base + index * slot_bytes; }
+
+    /* the extents of the slot starting at `mem`, a slot of this arena or a slot with the same layout */
+    eid_t *beg_pos_at(char *mem) const { return reinterpret_cast<eid_t *>(mem); }
+    vid_t *csr_at(char *mem) const { return reinterpret_cast<vid_t *>(mem + beg_pos_bytes); }
+    uint32_t *offsets_at(char *mem) const { return reinterpret_cast<uint32_t *>(mem); }
+    uint8_t *packed_at(char *mem) const { return reinterpret_cast<uint8_t *>(mem + beg_pos_bytes); }
+    real_t *weights_at(char *mem) const { return weight_bytes ? reinterpret_cast<real_t *>(mem + beg_pos_bytes + csr_bytes) : NULL; }
+
+    eid_t *beg_pos(bid_t index) const { return beg_pos_at(slot(index)); }
+    vid_t *csr(bid_t index) const { return csr_at(slot(index)); }
+    uint32_t *offsets(bid_t index) const { return offsets_at(slot(index)); }
+    uint8_t *packed(bid_t index) const { return packed_at(slot(index)); }
+    real_t *weights(bid_t index) const { return weights_at(slot(index)); }
+};
+
+#endif
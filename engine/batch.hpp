@@ -0,0 +1,137 @@
+#ifndef _GRAPH_BATCH_H_
+#define _GRAPH_BATCH_H_
+
+#include <unistd.h>
+#include <string>
+#include <fstream>
+#include <limits>
+#include <algorithm>
+#include "api/types.hpp"
+#include "api/constants.hpp"
+#include "logger/logger.hpp"
+#include "config.hpp"
+#include "bucket.hpp"
+
+/** batch_sizer
+ *
+ * This file contribute to define the size of the walk batches. The walks of the scheduled block pairs are walked in
+ * batches of at most `size()` walks, the memory walks are gathered pair by pair and the disk walks are read batch
+ * by batch at this size. A small batch does not amortize the scheduling and the parallel loop, a large one falls
+ * out of the cpu cache and takes memory, the best size depends on the graph, the app and the machine.
+ *
+ * `fixed`    : keep the batch at `BATCH_START_FACTOR` times `thread_walks` walks per thread
+ * `adaptive` : measure the steps per second of each round, and grow or shrink the batch by `BATCH_GROW` times
+ *              between rounds, turn around when a round gets slower. a batch only grows if the batches of the round
+ *              were full, the scheduled pairs hold more walks than a batch, and the available memory backs the buffers.
+ *
+ * The batch never falls below `thread_walks` walks per thread, the memory walks of one block pair always fit into
+ * one batch, nor below one compressed walk chunk (`WALK_CHUNK_WALKS`), which is read whole, and never grows over
+ * `max_batch_walks`, the capacity of the batch buffers.
+ *
+ * The `BATCH_BUFFERS` buffers are allocated at the capacity up front, `BATCH_BUFFERS * max_batch_walks * sizeof(walker_t)`
+ * bytes, as a batch may grow up to it. The malloc and transparent huge page buffers are only backed by memory as the
+ * batches grow into them, the explicit huge pages are reserved at once, lower `bwalks` to bound them.
+ */
+
+#define BATCH_START_FACTOR 5    /* the batch starts at 5 times `thread_walks` walks per thread */
+#define BATCH_GROW 2            /* the factor of each resize */
+#define BATCH_TOLERANCE 0.05    /* a round slower by more than 5% turns the resize around */
+#define BATCH_BUFFERS 3         /* the batch, the reorder scratch and the disk walk read ahead */
+#define BATCH_MEMORY_SHARE 8    /* the batch buffers take at most 1/8 of the available memory */
+
+/* the walks of the largest batch, the capacity of the batch buffers */
+inline wid_t max_batch_walks(const graph_config &conf) {
+    wid_t nthreads = std::max(conf.max_nthreads, conf.nthreads);
+    return std::max<wid_t>(nthreads * std::max<wid_t>(conf.block_walks, conf.thread_walks * BATCH_START_FACTOR), WALK_CHUNK_WALKS);
+}
+
+class batch_sizer {
+private:
+    wid_t min_walks, max_walks, walks;
+    bool adaptive;
+    int direction;              /* grow (1) or shrink (-1) the batch at the next resize */
+    double last_rate;           /* the steps per second of the last round, 0 before the first round */
+    size_t steps;               /* the steps of the current round */
+    double seconds;             /* the walking time of the current round */
+    wid_t largest;              /* the largest batch of the current round */
+
+    /* the bytes the system can give without swapping, MemAvailable counts the reclaimable page cache, MemFree does not */
+    static double available_bytes() {
+        std::ifstream meminfo("/proc/meminfo");
+        std::string key;
+        size_t kbytes;
+        while(meminfo >> key >> kbytes) {
+            if(key == "MemAvailable:") return (double)kbytes * 1024;
+            meminfo.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        }
+        long pages = sysconf(_SC_AVPHYS_PAGES), page_size = sysconf(_SC_PAGESIZE);
+        if(pages <= 0 || page_size <= 0) return -1.0;
+        return (double)pages * page_size;
+    }
+
+    /* the available memory backs the batch buffers of `nwalks` walks */
+    static bool fits(wid_t nwalks) {
+        double bytes = available_bytes();
+        if(bytes < 0) return true;
+        return (double)nwalks * sizeof(walker_t) * BATCH_BUFFERS * BATCH_MEMORY_SHARE <= bytes;
+    }
+
+public:
+    size_t nresizes;            /* the resizes of the batch */
+    wid_t peak;                 /* the largest size of the batch */
+
+    batch_sizer() : min_walks(0), max_walks(0), walks(0), adaptive(false), direction(1), last_rate(0.0),
+                    steps(0), seconds(0.0), largest(0), nresizes(0), peak(0) { }
+
+    void setup(const graph_config &conf) {
+        wid_t nthreads = std::max(conf.max_nthreads, conf.nthreads);
+        min_walks = std::max<wid_t>(nthreads * std::max<wid_t>(conf.thread_walks, 1), WALK_CHUNK_WALKS);
+        max_walks = max_batch_walks(conf);
+        walks = std::max<wid_t>(min_walks, nthreads * conf.thread_walks * BATCH_START_FACTOR);
+        adaptive = conf.batch_sizing != "fixed";
+        if(conf.batch_sizing != "fixed" && conf.batch_sizing != "adaptive") logstream(LOG_WARNING) << "unknown batch sizing " << conf.batch_sizing << ", use adaptive" << std::endl;
+        while(adaptive && walks > min_walks && !fits(walks)) walks = std::max(min_walks, walks / BATCH_GROW);
+        peak = walks;
+        logstream(LOG_INFO) << "walk batch : " << walks << " walks, " << (adaptive ? "adaptive in [" : "fixed, [") << min_walks << ", " << max_walks << "]" << std::endl;
+    }
+
+    wid_t size() const { return walks; }
+
+    /* a batch of `nwalks` walks has made `nsteps` steps in `time` seconds */
+    void record(wid_t nwalks, size_t nsteps, double time) {
+        steps += nsteps;
+        seconds += time;
+        largest = std::max(largest, nwalks);
+    }
+
+    /* resize the batch at the end of a round, `resident` is the walks of the block pairs scheduled in the round */
+    void adjust(wid_t resident) {
+        if(adaptive && steps > 0 && seconds > 0.0) {
+            double rate = steps / seconds;
+            if(last_rate > 0.0 && rate < last_rate * (1.0 - BATCH_TOLERANCE)) direction = -direction;
+            last_rate = rate;
+
+            wid_t next = walks;
+            if(direction > 0) {
+                wid_t grown = std::min(max_walks, walks * BATCH_GROW);
+                if(largest >= walks && resident > walks && fits(grown)) next = grown;
+            } else {
+                next = std::max(min_walks, walks / BATCH_GROW);
+            }
+            /* bounce back from the bounds, the next round measures the other way */
+            if(next == min_walks) direction = 1;
+            if(next == max_walks) direction = -1;
+            if(next != walks) {
+                logstream(LOG_DEBUG) << "resize the walk batch from " << walks << " to " << next << " walks, " << rate << " steps/s" << std::endl;
+                walks = next;
+                nresizes++;
+                peak = std::max(peak, walks);
+            }
+        }
+        steps = 0;
+        seconds = 0.0;
+        largest = 0;
+    }
+};
+
+#endif
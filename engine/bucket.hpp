@@ -0,0 +1,190 @@
+#ifndef _GRAPH_BUCKET_H_
+#define _GRAPH_BUCKET_H_
+
+#include <mutex>
+#include <vector>
+#include <limits>
+#include <cstring>
+#include <algorithm>
+#include "api/types.hpp"
+#include "util/hugepage.hpp"
+
+/** walk_pool, walk_bucket
+ *
+ * This file contribute to define the memory walk buckets of the block pairs. A bucket is a list of fixed size
+ * chunks of `WALK_CHUNK_WALKS` walkers, the chunks are drawn lazily from a pool shared by all the buckets and
+ * returned when the bucket is spilled or read, so the memory follows the live walks instead of the number of
+ * block pairs and threads.
+ *
+ * The pool holds at most `capacity` bytes of chunks in use. When a thread finds the pool exhausted it spills one
+ * of its own buckets chosen by the spill policy, no thread touches the bucket of another thread:
+ *
+ * `largest` : the largest bucket of the thread
+ * `current` : the bucket the walk moves into, the largest one if that bucket is empty
+ *
+ * A thread that holds no chunk takes one over the cap, so the cap is exceeded by at most one chunk per thread.
+ * Between the rounds `trim` releases the slabs with no chunk in use, down to the most chunks in use during the
+ * round, so the pool does not keep the memory of an early peak.
+ */
+
+#define WALK_CHUNK_WALKS 256    /* the walkers of a chunk */
+#define WALK_SLAB_CHUNKS 64     /* the chunks allocated at once */
+
+class walk_pool {
+private:
+    std::mutex mtx;
+    std::vector<walker_t *> free_chunks;
+    std::vector<walker_t *> slabs;
+    std::vector<size_t> slab_chunks;    /* the chunks of each slab */
+    size_t cap_chunks, nallocated, nused;
+    size_t round_peak;                  /* the most chunks in use since the last `trim` */
+
+    /* the index in `slabs` of the slab holding `chunk`, `bases` is the (slab, index) pairs sorted by address */
+    static size_t slab_of(const std::vector<std::pair<walker_t *, size_t>> &bases, walker_t *chunk) {
+        auto it = std::upper_bound(bases.begin(), bases.end(), std::make_pair(chunk, std::numeric_limits<size_t>::max()));
+        return (it - 1)->second;
+    }
+
+public:
+    size_t peak, noverdrafts;   /* the most chunks in use, the chunks taken over the cap */
+    size_t nreleased;           /* the chunks returned to the system by `trim` */
+
+    walk_pool() : cap_chunks(std::numeric_limits<size_t>::max()), nallocated(0), nused(0), round_peak(0), peak(0), noverdrafts(0), nreleased(0) { }
+
+    ~walk_pool() {
+        for(walker_t *slab : slabs) hugepage_free(slab);
+    }
+
+    static size_t chunk_bytes() { return WALK_CHUNK_WALKS * sizeof(walker_t); }
+
+    /* `capacity` bytes of chunks in use at most, 0 means no cap */
+    void setup(size_t capacity) {
+        cap_chunks = capacity == 0 ? std::numeric_limits<size_t>::max() : std::max<size_t>(capacity / chunk_bytes(), 1);
+    }
+
+    bool capped() const { return cap_chunks != std::numeric_limits<size_t>::max(); }
+
+    /* a free chunk, NULL if the pool is exhausted, unless `force` */
+    walker_t *acquire(bool force) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(nused >= cap_chunks) {
+            if(!force) return NULL;
+            noverdrafts++;
+        }
+        if(free_chunks.empty()) {
+            size_t nchunks = WALK_SLAB_CHUNKS;
+            if(capped()) nchunks = nallocated < cap_chunks ? std::min<size_t>(nchunks, cap_chunks - nallocated) : 1;
+            walker_t *slab = static_cast<walker_t *>(hugepage_alloc(nchunks * chunk_bytes()));
+            slabs.push_back(slab);
+            slab_chunks.push_back(nchunks);
+            for(size_t c = 0; c < nchunks; c++) free_chunks.push_back(slab + c * WALK_CHUNK_WALKS);
+            nallocated += nchunks;
+        }
+        walker_t *chunk = free_chunks.back();
+        free_chunks.pop_back();
+        peak = std::max(peak, ++nused);
+        round_peak = std::max(round_peak, nused);
+        return chunk;
+    }
+
+    void release(walker_t *chunk) {
+        std::lock_guard<std::mutex> lock(mtx);
+        free_chunks.push_back(chunk);
+        nused--;
+    }
+
+    /* release the slabs with no chunk in use while the pool keeps the most chunks in use since the last call, no thread may take chunks meanwhile */
+    void trim() {
+        std::lock_guard<std::mutex> lock(mtx);
+        size_t keep = round_peak;
+        round_peak = nused;
+        if(nallocated <= keep || free_chunks.empty()) return;
+        std::vector<std::pair<walker_t *, size_t>> bases(slabs.size());
+        for(size_t i = 0; i < slabs.size(); i++) bases[i] = std::make_pair(slabs[i], i);
+        std::sort(bases.begin(), bases.end());
+        std::vector<size_t> nfree(slabs.size(), 0);
+        for(walker_t *chunk : free_chunks) nfree[slab_of(bases, chunk)]++;
+
+        std::vector<uint8_t> released(slabs.size(), 0);
+        size_t nslabs = 0;
+        for(size_t i = 0; i < slabs.size(); i++) {
+            if(nfree[i] == slab_chunks[i] && nallocated - slab_chunks[i] >= keep) {
+                released[i] = 1;
+                nallocated -= slab_chunks[i];
+                nreleased += slab_chunks[i];
+                hugepage_free(slabs[i]);
+            } else {
+                slabs[nslabs] = slabs[i];
+                slab_chunks[nslabs++] = slab_chunks[i];
+            }
+        }
+        if(nslabs == slabs.size()) return;
+        size_t nkept = 0;
+        for(walker_t *chunk : free_chunks) {
+            if(!released[slab_of(bases, chunk)]) free_chunks[nkept++] = chunk;
+        }
+        free_chunks.resize(nkept);
+        slabs.resize(nslabs);
+        slab_chunks.resize(nslabs);
+    }
+
+    size_t used_bytes() const { return nused * chunk_bytes(); }
+    size_t peak_bytes() const { return peak * chunk_bytes(); }
+    size_t allocated_bytes() const { return nallocated * chunk_bytes(); }
+    size_t released_bytes() const { return nreleased * chunk_bytes(); }
+};
+
+class walk_bucket {
+private:
+    std::vector<walker_t *> chunks;
+    size_t nwalks;
+
+public:
+    walk_bucket() : nwalks(0) { }
+
+    size_t size() const { return nwalks; }
+    bool empty() const { return nwalks == 0; }
+    size_t nchunks() const { return chunks.size(); }
+    walker_t *chunk(size_t c) const { return chunks[c]; }
+    size_t chunk_size(size_t c) const { return c + 1 < chunks.size() ? WALK_CHUNK_WALKS : nwalks - c * WALK_CHUNK_WALKS; }
+
+    const walker_t &operator[](size_t off) const { return chunks[off / WALK_CHUNK_WALKS][off % WALK_CHUNK_WALKS]; }
+
+    /* append `walker`, false if a new chunk is needed and the pool is exhausted, unless `force` */
+    bool push_back(const walker_t &walker, walk_pool &pool, bool force = false) {
+        if(nwalks == chunks.size() * WALK_CHUNK_WALKS) {
+            walker_t *chunk = pool.acquire(force);
+            if(chunk == NULL) return false;
+            chunks.push_back(chunk);
+        }
+        chunks.back()[nwalks % WALK_CHUNK_WALKS] = walker;
+        nwalks++;
+        return true;
+    }
+
+    /* append the `n` walkers of `walkers` chunk by chunk, return the number appended, fewer if a new chunk is needed and the pool is exhausted, unless `force` */
+    size_t append(const walker_t *walkers, size_t n, walk_pool &pool, bool force = false) {
+        size_t done = 0;
+        while(done < n) {
+            if(nwalks == chunks.size() * WALK_CHUNK_WALKS) {
+                walker_t *chunk = pool.acquire(force);
+                if(chunk == NULL) break;
+                chunks.push_back(chunk);
+            }
+            size_t off = nwalks % WALK_CHUNK_WALKS, cnt = std::min(n - done, (size_t)WALK_CHUNK_WALKS - off);
+            memcpy(chunks.back() + off, walkers + done, cnt * sizeof(walker_t));
+            nwalks += cnt;
+            done += cnt;
+        }
+        return done;
+    }
+
+    /* return the chunks to the pool */
+    void clear(walk_pool &pool) {
+        for(walker_t *chunk : chunks) pool.release(chunk);
+        chunks.clear();
+        nwalks = 0;
+    }
+};
+
+#endif
@@ -5,14 +5,27 @@
 #include <cstdlib>
 #include <cassert>
 #include <mutex>
+#include <condition_variable>
 #include <memory>
+#include <atomic>
+#include <algorithm>
+#include <limits>
+#include <climits>
 
 #include "api/constants.hpp"
 #include "api/types.hpp"
 #include "util/util.hpp"
 #include "util/hash.hpp"
 #include "util/io.hpp"
+#include "util/blockindex.hpp"
+#include "util/bitpack.hpp"
 #include "config.hpp"
+#include "arena.hpp"
+#include "policy.hpp"
+#include "hub.hpp"
+#include "shared.hpp"
+#include "storage.hpp"
+#include "tail.hpp"
 
 /**
  * This file contribute to define graph block cache structure and some operations
@@ -77,6 +90,26 @@ public:
 #endif
 };
 
+/** selective block loading
+ *
+ * A block with only a few pending walks can be loaded selectively: only the vertex chunks touched by the walks
+ * are read, into the same positions as in a full load, and the other chunks are read on demand when a walk
+ * reaches them. `cache_block::adjacency` hides the difference from the walk update code.
+ */
+
+#define SPARSE_CHUNK 64 /* the number of vertices of one residency unit */
+#define SPARSE_GAP   4  /* coalesce two chunk ranges into one read when at most `SPARSE_GAP` chunks apart */
+#define TAIL_SELECTIVE 1.0  /* the selective ratio of the tail of a run, a block with fewer walks than chunks is loaded selectively */
+
+class cache_block;
+
+/* read the vertex range [first, last) of a selectively loaded block on demand */
+class block_loader {
+public:
+    virtual void load_vertex_range(cache_block &cblock, vid_t first, vid_t last) = 0;
+    virtual ~block_loader() { }
+};
+
 class cache_block {
 public:
     block_t *block;
@@ -86,10 +119,14 @@ public:
     vid_t *csr;
     real_t *weights;
 
-    /**
-     * record each block life, when swap out, the largest life block will be evicted
-     */
-    int life;
+    uint32_t *offsets;                  /* the record offsets of a bit packed block, NULL for a raw block */
+    uint8_t *packed;                    /* the bit packed records, see `util/bitpack.hpp` */
+
+    bool sparse;                        /* only the resident chunks of the block are loaded */
+    bool shared;                        /* the block lives in the shared cache, referenced by this job */
+    std::atomic<uint8_t> *resident;     /* the residency of each chunk of a sparse block */
+    std::mutex *fault_mtx;              /* serialize the on demand reads of a sparse block */
+    block_loader *loader;
 
     cache_block() {
         block   = NULL;
@@ -97,44 +134,42 @@ public:
         degree  = NULL;
         csr     = NULL;
         weights = NULL;
-        life = 0;
+        offsets = NULL;
+        packed  = NULL;
+        sparse = false;
+        shared = false;
+        resident = NULL;
+        fault_mtx = NULL;
+        loader = NULL;
+    }
+
+    /* the adjacency [head, tail) of the vertex at offset `off`, relative to the block csr */
+    void adjacency(vid_t off, eid_t &head, eid_t &tail) {
+        if(sparse) fault(off / SPARSE_CHUNK);
+        head = beg_pos[off] - block->start_edge;
+        tail = beg_pos[off + 1] - block->start_edge;
+    }
+
+    void fault(vid_t chunk) {
+        if(resident[chunk].load(std::memory_order_acquire)) return;
+        std::lock_guard<std::mutex> lock(*fault_mtx);
+        if(resident[chunk].load(std::memory_order_relaxed)) return;
+        vid_t first = chunk * SPARSE_CHUNK;
+        loader->load_vertex_range(*this, first, std::min(first + SPARSE_CHUNK, block->nverts));
+        resident[chunk].store(1, std::memory_order_release);
     }
 
+    /* beg_pos, csr and weights are extents of the block arena, owned by graph_cache */
     ~cache_block() {
-        if(beg_pos) free(beg_pos);
         if(degree)  free(degree);
-        if(csr)     free(csr);
-        if(weights) free(weights);
     }
 };
 
-void swap(cache_block& cb1, cache_block& cb2) {
-    block_t *tblock = cb2.block;
-    eid_t *tbeg_pos = cb2.beg_pos;
-    vid_t *tdegree  = cb2.degree;
-    vid_t *tcsr     = cb2.csr;
-    real_t *tw      = cb2.weights;
-    int tlife       = cb2.life;
-
-    cb2.block = cb1.block;
-    cb2.beg_pos = cb1.beg_pos;
-    cb2.degree = cb1.degree;
-    cb2.csr = cb1.csr;
-    cb2.weights = cb1.weights;
-    cb2.life    = cb1.life;
-
-    cb1.block = tblock;
-    cb1.beg_pos = tbeg_pos;
-    cb1.degree = tdegree;
-    cb1.csr = tcsr;
-    cb1.weights = tw;
-    cb1.life = tlife;
-}
-
 class graph_block {
 public:
     bid_t nblocks;
     std::vector<block_t> blocks;
+    block_index index;              /* map a vertex to its block */
 
     graph_block(graph_config* conf) {
         std::string vert_block_name = get_vert_blocks_name(conf->base_name, conf->blocksize);
@@ -162,6 +197,8 @@ public:
             logstream(LOG_INFO) << "blk [ " << blk << " ] : vert = [ " << blocks[blk].start_vert << ", " << blocks[blk].start_vert + blocks[blk].nverts << " ], csr = [ ";
             logstream(LOG_INFO) << blocks[blk].start_edge << ", " << blocks[blk].start_edge + blocks[blk].nedges << " ]" << std::endl;
         }
+        index.build(vblocks, conf->block_map);
+        walker_block_index = &index;
     }
 
     block_t& operator[](bid_t blk) {
@@ -180,12 +217,8 @@ public:
         blocks[blk].rank += 1;
     }
 
-    bid_t get_block(vid_t v) {
-        bid_t blk = 0;
-        for(; blk < nblocks; blk++) {
-            if(v < blocks[blk].start_vert + blocks[blk].nverts) return blk;
-        }
-        return nblocks;
+    bid_t get_block(vid_t v) const {
+        return index.get_block(v);
     }
 
 #ifdef PROF_METRIC
@@ -198,16 +231,271 @@ public:
 };
 
 class graph_cache {
+private:
+    /**
+     * the bit packed record bytes of each block, counted with one pass over the dataset files and kept in the
+     * packed blocks file for the next runs
+     */
+    static std::vector<size_t> load_packed_bytes(graph_config *conf, const graph_block &blocks) {
+        std::string name = get_packed_blocks_name(conf->base_name, conf->blocksize);
+        if(test_exists(name)) {
+            std::vector<size_t> packed_bytes = load_graph_blocks<size_t>(name);
+            if(packed_bytes.size() == blocks.nblocks) return packed_bytes;
+            test_delete(name);
+        }
+        std::vector<size_t> packed_bytes(blocks.nblocks, 0);
+        int vertdesc = open(get_beg_pos_name(conf->base_name).c_str(), O_RDONLY);
+        int edgedesc = open(get_csr_name(conf->base_name).c_str(), O_RDONLY);
+        assert(vertdesc >= 0 && edgedesc >= 0);
+        std::vector<eid_t> beg_pos;
+        std::vector<vid_t> csr;
+        for(bid_t blk = 0; blk < blocks.nblocks; blk++) {
+            const block_t &block = blocks.blocks[blk];
+            beg_pos.resize(block.nverts + 1);
+            csr.resize(block.nedges);
+            load_block_range(vertdesc, beg_pos.data(), block.nverts + 1, block.start_vert * sizeof(eid_t));
+            if(block.nedges > 0) load_block_range(edgedesc, csr.data(), block.nedges, block.start_edge * sizeof(vid_t));
+            for(vid_t v = 0; v < block.nverts; v++) {
+                packed_bytes[blk] += bitpack_record_bytes(csr.data() + (beg_pos[v] - block.start_edge), beg_pos[v + 1] - beg_pos[v]);
+            }
+            assert(packed_bytes[blk] <= std::numeric_limits<uint32_t>::max());
+        }
+        close(vertdesc);
+        close(edgedesc);
+        appendfile(name, packed_bytes.data(), packed_bytes.size());
+        return packed_bytes;
+    }
+
 public:
     bid_t ncblock;                  /* number of cache blocks */
     std::vector<cache_block> cache_blocks; /* the cached blocks */
     std::vector<bid_t> walk_blocks;
+    block_arena arena;              /* the memory of the cache blocks, reserved once */
+    block_arena staging;            /* the raw extents the bit packed blocks are read into before the encoding, one per storage root */
+    std::vector<bid_t> free_staging;
+    std::mutex staging_mtx;
+    std::condition_variable staging_cv;
+    real_t selective;               /* the pending walks to vertex chunks ratio below which a block is loaded selectively */
+    bool tail;                      /* a few walks are left, the blocks are loaded selectively at `TAIL_SELECTIVE` at least, and the walks read the lists of the uncached blocks directly */
+    graph_tail_reader direct;       /* the direct adjacency reads of the tail mode */
+    bool sparse_capable;            /* the cache blocks can be loaded selectively */
+    graph_block *global_blocks;
+    cache_policy *policy;           /* choose the block to evict */
+    size_t nhits, nmisses;          /* the needed blocks found in the cache and loaded */
+    graph_hub hubs;                 /* the adjacency lists of the hot vertices, kept across the block swaps */
+    real_t packed_ratio;            /* the raw slot bytes to the bit packed slot bytes, 0 for the raw blocks */
+    bool packed_mode, shared_mode;
+    graph_shared_cache shared;      /* the blocks shared with the other jobs on the dataset */
+    std::vector<char *> private_slots; /* the memory of the blocks that do not fit into the shared cache */
+
+    graph_cache(bid_t nblocks, graph_config *conf, graph_block &blocks) {
+        huge_allocator.mode = conf->hugepage;
+        global_blocks = &blocks;
+        nhits = nmisses = 0;
+        vid_t max_nverts = 0;
+        eid_t max_nedges = 0;
+        for(bid_t blk = 0; blk < blocks.nblocks; blk++) {
+            max_nverts = std::max(max_nverts, blocks.blocks[blk].nverts);
+            max_nedges = std::max(max_nedges, blocks.blocks[blk].nedges);
+        }
+        size_t slot_bytes = block_arena::slot_size(max_nverts, max_nedges, conf->is_weighted);
+        packed_ratio = 0.0;
+        packed_mode = conf->packed_blocks;
+        shared_mode = conf->shared_cache > 0;
+        if(packed_mode) {
+            /* more bit packed blocks fit into the same cache size */
+            std::vector<size_t> packed_bytes = load_packed_bytes(conf, blocks);
+            size_t max_packed = *std::max_element(packed_bytes.begin(), packed_bytes.end());
+            size_t packed_slot = block_arena::packed_slot_size(max_nverts, max_packed);
+            packed_ratio = (real_t)slot_bytes / packed_slot;
+            logstream(LOG_INFO) << "bit packed blocks : " << packed_slot << " bytes per slot, " << packed_ratio << "x smaller than the raw blocks" << std::endl;
+            /* the blocks of different storage roots are read in parallel, each reader encodes from its own staging slot */
+            size_t nstaging = graph_storage::count_roots(conf->storage_roots);
+            staging.reserve(nstaging, max_nverts, max_nedges, conf->is_weighted);
+            staging.prefault(conf->nthreads);
+            for(bid_t s = 0; s < nstaging; s++) free_staging.push_back(s);
+            setup(nblocks, conf->cache_size > staging.total_bytes ? conf->cache_size - staging.total_bytes : 0, packed_slot);
+            if(shared_mode) arena.layout_packed(max_nverts, max_packed);
+            else arena.reserve_packed(ncblock, max_nverts, max_packed);
+        } else {
+            setup(nblocks, conf->cache_size, slot_bytes);
+            if(shared_mode) arena.layout(max_nverts, max_nedges, conf->is_weighted);
+            else arena.reserve(ncblock, max_nverts, max_nedges, conf->is_weighted);
+        }
 
-    graph_cache(bid_t nblocks, graph_config *conf) {
-        setup(nblocks, conf->cache_size, conf->blocksize);
-        for(bid_t blk = 0; blk < nblocks; blk++) {
-            cache_blocks[blk].csr = (vid_t*)malloc(conf->blocksize);
+        if(shared_mode) {
+            /* the blocks are bound to the shared slots as they are loaded */
+            private_slots.assign(ncblock, NULL);
+            char path[PATH_MAX];
+            std::string key = realpath(get_csr_name(conf->base_name).c_str(), path) ? std::string(path) : conf->base_name;
+            shared.open(key + "#" + std::to_string(conf->blocksize), blocks.nblocks, arena.slot_bytes, conf->shared_cache, (packed_mode ? 1 : 0) | (conf->is_weighted ? 2 : 0));
+        } else {
+            for(bid_t p = 0; p < ncblock; p++) bind_slot(cache_blocks[p], arena.slot(p));
+            arena.prefault(conf->nthreads);
+        }
+
+        selective = conf->selective;
+        tail = false;
+        if(selective > 0.0 && (packed_mode || shared_mode)) {
+            logstream(LOG_WARNING) << "the bit packed and shared blocks are always loaded whole, ignore selective" << std::endl;
+            selective = 0.0;
         }
+        sparse_capable = (selective > 0.0 || conf->tail_walks > 0) && !packed_mode && !shared_mode;
+        if(sparse_capable) {
+            vid_t nchunks = (max_nverts + SPARSE_CHUNK - 1) / SPARSE_CHUNK;
+            for(bid_t p = 0; p < ncblock; p++) {
+                cache_blocks[p].resident  = new std::atomic<uint8_t>[nchunks];
+                cache_blocks[p].fault_mtx = new std::mutex;
+            }
+        }
+        policy = make_cache_policy(conf->cache_policy, blocks.nblocks, ncblock);
+        hubs.setup(conf);
+        if(conf->tail_walks > 0) direct.setup(conf);
+    }
+
+    ~graph_cache() {
+        delete policy;
+        for(bid_t p = 0; p < ncblock; p++) {
+            if(cache_blocks[p].shared) shared.release(cache_blocks[p].block->blk);
+            if(p < private_slots.size() && private_slots[p]) free(private_slots[p]);
+        }
+        for(bid_t p = 0; p < ncblock; p++) {
+            if(cache_blocks[p].resident)  delete [] cache_blocks[p].resident;
+            if(cache_blocks[p].fault_mtx) delete cache_blocks[p].fault_mtx;
+        }
+    }
+
+    /* a staging slot for a bit packed load, waits while the other readers hold all of them */
+    bid_t acquire_staging() {
+        std::unique_lock<std::mutex> lock(staging_mtx);
+        staging_cv.wait(lock, [this]() { return !free_staging.empty(); });
+        bid_t s = free_staging.back();
+        free_staging.pop_back();
+        return s;
+    }
+
+    void release_staging(bid_t s) {
+        {
+            std::lock_guard<std::mutex> lock(staging_mtx);
+            free_staging.push_back(s);
+        }
+        staging_cv.notify_one();
+    }
+
+    /* load the block selectively if its `nwalks` pending walks touch only a small part of its vertex chunks */
+    bool selective_load(const block_t &block, wid_t nwalks) const {
+        real_t ratio = tail && sparse_capable ? std::max<real_t>(selective, TAIL_SELECTIVE) : selective;
+        if(ratio <= 0.0) return false;
+        vid_t nchunks = (block.nverts + SPARSE_CHUNK - 1) / SPARSE_CHUNK;
+        return nwalks < ratio * nchunks;
+    }
+
+    /* record the use of the resident block `blk` */
+    void hit(bid_t blk) {
+        nhits++;
+        policy->hit(blk);
+    }
+
+    /**
+     * reserve a slot for the missed block `blk`, a free slot if any, otherwise the slot of the block chosen by
+     * the policy among the blocks not `pinned`. the caller loads the block into the returned slot.
+     */
+    bid_t miss(bid_t blk, const std::vector<bool> &pinned) {
+        nmisses++;
+        policy->miss(blk);
+        bid_t slot = ncblock;
+        for(bid_t p = 0; p < ncblock && slot == ncblock; p++) {
+            if(cache_blocks[p].block == NULL) slot = p;
+        }
+        if(slot == ncblock) {
+            std::vector<bid_t> resident;
+            for(bid_t p = 0; p < ncblock; p++) {
+                if(!pinned[cache_blocks[p].block->blk]) resident.push_back(cache_blocks[p].block->blk);
+            }
+            assert(!resident.empty());
+            block_t &victim = global_blocks->blocks[policy->victim(resident)];
+            slot = victim.cache_index;
+            if(cache_blocks[slot].shared) {
+                shared.release(victim.blk);
+                cache_blocks[slot].shared = false;
+            }
+            victim.cache_index = global_blocks->nblocks;
+            victim.status = INACTIVE;
+            policy->evict(victim.blk);
+        }
+        cache_blocks[slot].block = &global_blocks->blocks[blk];
+        cache_blocks[slot].block->cache_index = slot;
+        policy->insert(blk);
+        return slot;
+    }
+
+    /* the adjacency list of the vertex `v` of block `blk`, from the cached block or the hubs, false if neither holds it */
+    bool adjacency(bid_t blk, vid_t v, adj_list &list) {
+        const block_t &block = global_blocks->blocks[blk];
+        if(block.cache_index != global_blocks->nblocks) {
+            cache_block &cblock = cache_blocks[block.cache_index];
+            if(cblock.packed) {
+                list = adj_list(cblock.packed + cblock.offsets[v - block.start_vert]);
+                return true;
+            }
+            eid_t head, tail;
+            cblock.adjacency(v - block.start_vert, head, tail);
+            list = adj_list(cblock.csr + head, tail - head);
+            return true;
+        }
+        const vid_t *hub_list;
+        eid_t hub_deg;
+        if(hubs.find(v, hub_list, hub_deg)) {
+            list = adj_list(hub_list, hub_deg);
+            return true;
+        }
+        if(tail && direct.read(v, list)) return true;
+        hubs.stall(v);
+        return false;
+    }
+
+    /* point the extents of `cblock` at the slot memory `mem` */
+    void bind_slot(cache_block &cblock, char *mem) {
+        if(packed_mode) {
+            cblock.offsets = arena.offsets_at(mem);
+            cblock.packed  = arena.packed_at(mem);
+        } else {
+            cblock.beg_pos = arena.beg_pos_at(mem);
+            cblock.csr     = arena.csr_at(mem);
+            cblock.weights = arena.weights_at(mem);
+        }
+    }
+
+    /**
+     * bind the cache block `cache_index` to the memory of the block `blk`, a shared slot if any, otherwise a private
+     * slot. return false if another job has loaded the block into the shared cache, otherwise the caller loads the
+     * block and calls `publish`.
+     */
+    bool bind(bid_t cache_index, bid_t blk) {
+        if(!shared_mode) return true;
+        cache_block &cblock = cache_blocks[cache_index];
+        bool fill = true;
+        char *mem = shared.attached() ? shared.acquire(blk, fill) : NULL;
+        cblock.shared = mem != NULL;
+        if(mem == NULL) {
+            if(private_slots[cache_index] == NULL && posix_memalign(reinterpret_cast<void **>(&private_slots[cache_index]), ARENA_ALIGN, arena.slot_bytes) != 0) {
+                logstream(LOG_FATAL) << "can not allocate " << arena.slot_bytes << " bytes for a private block" << std::endl;
+                assert(false);
+            }
+            mem = private_slots[cache_index];
+        }
+        bind_slot(cblock, mem);
+        return fill;
+    }
+
+    /* the block of the cache block `cache_index` is loaded, share it with the other jobs */
+    void publish(bid_t cache_index) {
+        if(cache_blocks[cache_index].shared) shared.ready(cache_blocks[cache_index].block->blk);
+    }
+
+    /* the future block accesses planned by the scheduler, used by the `belady` policy */
+    void plan(const std::vector<bid_t> &sequence) {
+        policy->plan(sequence);
     }
 
     cache_block& operator[](size_t index) {
@@ -222,7 +510,11 @@ public:
 
     void setup(bid_t nblocks, size_t cache_size, size_t blocksize = BLOCK_SIZE) {
         ncblock = min_value(nblocks, cache_size / blocksize);
-        assert(ncblock > 0);
+        /* a walk of a cross-block pair reads the adjacency lists of both blocks, so both must be resident */
+        bid_t min_ncblock = std::min<bid_t>(2, global_blocks->nblocks);
+        if(ncblock < min_ncblock) {
+            logstream(LOG_FATAL) << "the cache holds " << ncblock << " blocks of " << blocksize << " bytes (cache size " << cache_size << ", nmblocks " << nblocks << "), a block pair needs " << min_ncblock << " cache blocks, raise nmblocks or cache" << std::endl;
+        }
         cache_blocks.resize(ncblock);
     }
 
@@ -0,0 +1,329 @@
+#ifndef _GRAPH_CHECKPOINT_H_
+#define _GRAPH_CHECKPOINT_H_
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "api/types.hpp"
+#include "util/util.hpp"
+#include "util/io.hpp"
+#include "config.hpp"
+#include "walk.hpp"
+#include "schedule.hpp"
+
+/** graph_checkpoint
+ *
+ * This file contribute to define the checkpoint of the in-flight walks, taken at the round boundary.
+ *
+ * The walk files are not copied, the checkpoint only records the live range [start, end) of each walk file,
+ * and the walk files keep the walks that have been read (see `graph_walk::keep_consumed`), so the recorded
+ * ranges stay valid until the next checkpoint. The memory walks, the walk counters, the random states and the
+ * scheduler state are written into a temporary file which is synced and renamed over the last checkpoint, then the
+ * folder is synced so the rename itself is durable. Once renamed, the walks before the recorded start of each walk
+ * file are not referred to by any checkpoint, their range is punched out of the file, so the walk files of the hot
+ * pairs do not grow without bound (the file systems without hole punching keep it until the pair is drained).
+ * A failed sync or rename is fatal before any walk file is cut, so the last checkpoint stays whole on disk.
+ * When resuming, each walk file is truncated to its recorded end, which drops the walks spilled after the
+ * checkpoint, a walk file shorter than its recorded end is fatal. The trajectory buffers are spilled at the checkpoint, and the trajectory files are truncated
+ * in the same way.
+ *
+ * The lazy start walks are not written, only the state of the walk source, the pending start walks are counted again
+ * from the restored source.
+ *
+ * layout : header | (start, end, count) of each block pair | random states | scheduler state | source state | trajectory runs | memory walks | remaining steps histograms
+ */
+
+#define CHECKPOINT_MAGIC 0x36544b4357574f53ULL   /* "SOWWCKT6" */
+
+struct checkpoint_header_t {
+    uint64_t magic;
+    vid_t nvertices;
+    bid_t nblocks;
+    uint32_t nthreads;
+    uint32_t compress;
+    uint32_t run_count;
+    uint32_t trajectory;
+    uint32_t layout;        /* the walker field widths, the memory walks are stored packed */
+    uint32_t source;        /* the start walks are generated lazily */
+};
+
+struct checkpoint_range_t {
+    uint64_t start, end;    /* the live walks range of the walk file */
+    uint64_t nwalks;        /* the number of disk walks */
+};
+
+class checkpoint_file_t {
+private:
+    int fd;
+    off_t off;
+public:
+    checkpoint_file_t(const std::string &name, int flags) {
+        fd = open(name.c_str(), flags, S_IRUSR | S_IWUSR);
+        off = 0;
+    }
+    ~checkpoint_file_t() { if(fd >= 0) close(fd); }
+
+    bool good() const { return fd >= 0; }
+    int get_desc() const { return fd; }
+
+    /* a short or failed write is fatal, the checkpoint is not renamed over the last one */
+    template<typename T>
+    void write(const T *buf, size_t count) {
+        const char *ptr = reinterpret_cast<const char *>(buf);
+        size_t total = count * sizeof(T);
+        while(total > 0) {
+            ssize_t ret = pwrite(fd, ptr, total, off);
+            if(ret <= 0) logstream(LOG_FATAL) << "can not write the checkpoint, " << strerror(errno) << std::endl;
+            ptr += ret;
+            total -= ret;
+            off += ret;
+        }
+    }
+
+    template<typename T>
+    void read(T *buf, size_t count) {
+        if(count == 0) return;
+        load_block_range(fd, buf, count, off);
+        off += count * sizeof(T);
+    }
+};
+
+class graph_checkpoint {
+private:
+    graph_config *conf;
+    graph_walk *walk_manager;
+    std::string name;
+
+public:
+    graph_checkpoint(graph_config *_conf, graph_walk *manager) {
+        conf = _conf;
+        walk_manager = manager;
+        name = get_checkpoint_name(conf->base_name, conf->blocksize);
+    }
+
+    bool exists() const { return test_exists(name); }
+
+    /* sync the folder of the checkpoint, so the rename of the checkpoint reaches the disk, false on failure */
+    bool sync_folder() const {
+        size_t slash = name.find_last_of('/');
+        std::string folder = slash == std::string::npos ? "." : name.substr(0, std::max<size_t>(slash, 1));
+        int fd = open(folder.c_str(), O_RDONLY | O_DIRECTORY);
+        if(fd < 0) return false;
+        bool synced = fsync(fd) == 0;
+        close(fd);
+        return synced;
+    }
+
+    void dump(std::vector<RandNum> &seeds, scheduler &block_scheduler, int run_count) {
+        bid_t totblocks = walk_manager->totblocks;
+        std::vector<checkpoint_range_t> ranges(totblocks);
+        for(bid_t blk = 0; blk < totblocks; blk++) {
+            ranges[blk].start = walk_manager->block_doff[blk];
+            ranges[blk].end = walk_manager->block_doff[blk];
+            ranges[blk].nwalks = walk_manager->ndwalks(blk);
+            if(ranges[blk].nwalks == 0) continue;
+
+            /* the spilled walks must reach the disk before the checkpoint refers to them */
+            block_desc_manager_t block_desc(walk_manager->walk_name(blk));
+            off_t end = block_desc.get_desc() < 0 ? -1 : lseek(block_desc.get_desc(), 0, SEEK_END);
+            if(end < 0 || fdatasync(block_desc.get_desc()) != 0) {
+                logstream(LOG_FATAL) << "can not sync the walk file " << walk_manager->walk_name(blk) << " for the checkpoint, " << strerror(errno) << std::endl;
+            }
+            ranges[blk].end = end;
+        }
+
+        graph_trajectory *trajectory = walk_manager->trajectory;
+        if(trajectory) trajectory->flush(true);
+
+        std::string tmp_name = name + ".tmp";
+        {
+            checkpoint_file_t file(tmp_name, O_WRONLY | O_CREAT | O_TRUNC);
+            if(!file.good()) logstream(LOG_FATAL) << "can not create the checkpoint " << tmp_name << ", " << strerror(errno) << std::endl;
+
+            checkpoint_header_t header;
+            memset(&header, 0, sizeof(header));
+            header.magic = CHECKPOINT_MAGIC;
+            header.nvertices = walk_manager->nvertices;
+            header.nblocks = walk_manager->nblocks;
+            header.nthreads = walk_manager->nthreads;
+            header.compress = walk_manager->compress;
+            header.run_count = run_count;
+            header.trajectory = (trajectory != NULL);
+            header.layout = walker_layout.code();
+            header.source = (walk_manager->source != NULL);
+            file.write(&header, 1);
+            file.write(ranges.data(), totblocks);
+
+            std::vector<uint64_t> states;
+            for(auto &seed : seeds) {
+                states.push_back(seed.rng_seed0);
+                states.push_back(seed.rng_seed1);
+            }
+            file.write(states.data(), states.size());
+
+            std::ostringstream os;
+            block_scheduler.dump_state(os);
+            std::string sched_state = os.str();
+            uint64_t sched_len = sched_state.size();
+            file.write(&sched_len, 1);
+            file.write(sched_state.data(), sched_len);
+
+            if(walk_manager->source) {
+                std::ostringstream source_os;
+                walk_manager->source->dump_state(source_os);
+                std::string source_state = source_os.str();
+                uint64_t source_len = source_state.size();
+                file.write(&source_len, 1);
+                file.write(source_state.data(), source_len);
+            }
+
+            for(tid_t t = 0; trajectory && t < walk_manager->nthreads; t++) {
+                uint64_t nruns = trajectory->runs[t].size();
+                file.write(&trajectory->nrecords[t], 1);
+                file.write(&nruns, 1);
+                file.write(trajectory->runs[t].data(), nruns);
+            }
+
+            for(bid_t blk = 0; blk < totblocks; blk++) {
+                for(tid_t t = 0; t < walk_manager->nthreads; t++) {
+                    const walk_bucket &bucket = walk_manager->find_bucket(blk, t);
+                    wid_t nwalks = bucket.size();
+                    file.write(&nwalks, 1);
+                    for(size_t c = 0; c < bucket.nchunks(); c++) file.write(bucket.chunk(c), bucket.chunk_size(c));
+                }
+            }
+            file.write(walk_manager->pair_hops.data(), walk_manager->pair_hops.size());
+            if(fsync(file.get_desc()) != 0) {
+                logstream(LOG_FATAL) << "can not sync the checkpoint " << tmp_name << ", " << strerror(errno) << std::endl;
+            }
+        }
+        /* the last checkpoint stays valid, and its walk ranges untouched, until the new one is renamed over it on disk */
+        if(rename(tmp_name.c_str(), name.c_str()) != 0) {
+            logstream(LOG_FATAL) << "can not rename the checkpoint " << tmp_name << " to " << name << ", " << strerror(errno) << std::endl;
+        }
+        if(!sync_folder()) {
+            logstream(LOG_FATAL) << "can not sync the folder of the checkpoint " << name << ", " << strerror(errno) << std::endl;
+        }
+
+        /* the walk files without live walks, and the walks before the live ranges, are not referred by any checkpoint now */
+        for(bid_t blk = 0; blk < totblocks; blk++) {
+            if(ranges[blk].nwalks == 0 && walk_manager->block_doff[blk] > 0) {
+                /* the read offset only goes back to 0 once the file is empty, the kept walks must not be read again */
+                block_desc_manager_t block_desc(walk_manager->walk_name(blk));
+                if(block_desc.get_desc() >= 0 && ftruncate(block_desc.get_desc(), 0) == 0) walk_manager->block_doff[blk] = 0;
+                else logstream(LOG_WARNING) << "can not truncate the drained walk file " << walk_manager->walk_name(blk) << ", " << strerror(errno) << std::endl;
+            } else if(ranges[blk].nwalks > 0 && ranges[blk].start > 0) {
+#ifdef FALLOC_FL_PUNCH_HOLE
+                block_desc_manager_t block_desc(walk_manager->walk_name(blk));
+                if(block_desc.get_desc() < 0 || (fallocate(block_desc.get_desc(), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0, ranges[blk].start) != 0 && errno != EOPNOTSUPP)) {
+                    logstream(LOG_WARNING) << "can not punch the read walks out of " << walk_manager->walk_name(blk) << ", " << strerror(errno) << std::endl;
+                }
+#endif
+            }
+        }
+        logstream(LOG_INFO) << "checkpoint at run_count = " << run_count << ", walks = " << walk_manager->nwalks() << std::endl;
+    }
+
+    /* restore the walks state from the last checkpoint, return the run count of the checkpoint */
+    int restore(std::vector<RandNum> &seeds, scheduler &block_scheduler) {
+        checkpoint_file_t file(name, O_RDONLY);
+        assert(file.good());
+
+        checkpoint_header_t header;
+        file.read(&header, 1);
+        if(header.magic != CHECKPOINT_MAGIC || header.nvertices != walk_manager->nvertices || header.nblocks != walk_manager->nblocks
+            || header.nthreads != walk_manager->nthreads || (bool)header.compress != walk_manager->compress
+            || (bool)header.trajectory != (walk_manager->trajectory != NULL) || header.layout != walker_layout.code()
+            || (bool)header.source != (walk_manager->source != NULL)) {
+            logstream(LOG_FATAL) << "checkpoint " << name << " does not match the current graph, nthreads, compress, trajectory, walker or walk source setting." << std::endl;
+        }
+
+        bid_t totblocks = walk_manager->totblocks;
+        std::vector<checkpoint_range_t> ranges(totblocks);
+        file.read(ranges.data(), totblocks);
+        for(bid_t blk = 0; blk < totblocks; blk++) {
+            std::string walk_name = walk_manager->walk_name(blk);
+            if(ranges[blk].nwalks == 0) {
+                if(test_exists(walk_name)) unlink(walk_name.c_str());
+                walk_manager->block_doff[blk] = 0;
+                continue;
+            }
+            /* a missing or short walk file lost the walks of the checkpoint, it must not be extended with zeros */
+            int fd = open(walk_name.c_str(), O_RDWR);
+            struct stat st;
+            if(fd < 0 || fstat(fd, &st) != 0 || (uint64_t)st.st_size < ranges[blk].end) {
+                logstream(LOG_FATAL) << "the walk file " << walk_name << " does not hold the " << ranges[blk].end << " bytes of the checkpoint" << std::endl;
+            }
+            if(ftruncate(fd, ranges[blk].end) != 0) {
+                logstream(LOG_FATAL) << "can not truncate the walk file " << walk_name << " to the checkpoint, " << strerror(errno) << std::endl;
+            }
+            close(fd);
+            walk_manager->block_doff[blk] = ranges[blk].start;
+            walk_manager->add_walks(blk, 0, ranges[blk].nwalks);
+        }
+
+        std::vector<uint64_t> states(2 * seeds.size());
+        file.read(states.data(), states.size());
+        for(size_t t = 0; t < seeds.size(); t++) {
+            seeds[t].rng_seed0 = states[2 * t];
+            seeds[t].rng_seed1 = states[2 * t + 1];
+        }
+
+        uint64_t sched_len = 0;
+        file.read(&sched_len, 1);
+        std::string sched_state(sched_len, '\0');
+        file.read(&sched_state[0], sched_len);
+        std::istringstream is(sched_state);
+        block_scheduler.load_state(is);
+
+        walk_source *source = walk_manager->source;
+        if(source) {
+            uint64_t source_len = 0;
+            file.read(&source_len, 1);
+            std::string source_state(source_len, '\0');
+            file.read(&source_state[0], source_len);
+            std::istringstream source_is(source_state);
+            source->load_state(source_is);
+            for(bid_t blk = 0; blk < walk_manager->nblocks; blk++) {
+                walk_manager->add_source_walks(blk * walk_manager->nblocks + blk, source->pending(blk));
+            }
+        }
+
+        graph_trajectory *trajectory = walk_manager->trajectory;
+        for(tid_t t = 0; trajectory && t < walk_manager->nthreads; t++) {
+            uint64_t nrecords = 0, nruns = 0;
+            file.read(&nrecords, 1);
+            file.read(&nruns, 1);
+            trajectory->runs[t].resize(nruns);
+            file.read(trajectory->runs[t].data(), nruns);
+            trajectory->truncate(t, nrecords);
+        }
+
+        for(bid_t blk = 0; blk < totblocks; blk++) {
+            for(tid_t t = 0; t < walk_manager->nthreads; t++) {
+                wid_t nwalks = 0;
+                file.read(&nwalks, 1);
+                if(nwalks == 0) continue;
+                std::vector<walker_t> mwalks(nwalks);
+                file.read(mwalks.data(), nwalks);
+                walk_bucket &bucket = walk_manager->bucket(blk, t);
+                for(const walker_t &walker : mwalks) bucket.push_back(walker, walk_manager->pool, true);
+                walk_manager->add_walks(blk, nwalks, 0);
+            }
+        }
+        /* the histograms cover the memory, disk and pending start walks */
+        file.read(walk_manager->pair_hops.data(), walk_manager->pair_hops.size());
+        logstream(LOG_INFO) << "resume from checkpoint at run_count = " << header.run_count << ", walks = " << walk_manager->nwalks() << std::endl;
+        return header.run_count;
+    }
+
+    void remove() {
+        if(exists()) unlink(name.c_str());
+    }
+};
+
+#endif
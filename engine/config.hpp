@@ -3,6 +3,7 @@
 
 #include <string>
 #include "api/types.hpp"
+#include "util/hugepage.hpp"
 
 /** config
  *
@@ -19,6 +20,32 @@ struct graph_config {
     vid_t nvertices;
     eid_t nedges;
     bool is_weighted;
+
+    bool compress_walks;    /* spill walks in the compressed format */
+    size_t checkpoint;      /* take a checkpoint every `checkpoint` rounds, 0 means never */
+    bool resume;            /* continue from the last checkpoint */
+    std::string trajectory; /* the output file of the walk paths, empty means no output */
+    bool trajectory_text;   /* also write the walk paths in the text format */
+    std::string stream;     /* the shared memory name to stream the walk steps, empty means no streaming */
+    bool stream_fifo;       /* stream the walk steps into a named pipe instead of the shared memory */
+    std::string storage_roots; /* the comma separated storage directories for the block and walk files, empty means the dataset folder */
+    hugepage_mode hugepage; /* back the cache blocks and walk buffers with huge pages */
+    real_t selective;       /* load a block selectively when its pending walks are fewer than `selective` times its vertex chunks, 0 means never */
+    std::string cache_policy; /* the cache replacement policy, lru, lfu, arc or belady */
+    size_t hub_size;        /* the bytes of the pinned adjacency cache of the hot vertices, 0 means no hub cache */
+    std::string hub_rank;   /* rank the hub vertices by `degree` or by observed `visits` */
+    bool block_map;         /* map the vertices to the blocks with a packed per vertex map instead of the bucket table */
+    bool packed_blocks;     /* keep the cache blocks bit packed in memory, more blocks fit into the cache */
+    size_t shared_cache;    /* the bytes of the block cache shared with the concurrent jobs on the dataset, 0 means a private cache */
+    std::string preload;    /* warm up the cache before the first schedule, `snapshot` or `walks`, empty means no preload */
+    size_t walk_memory;     /* the bytes of the memory walk buckets, 0 means no cap */
+    std::string spill_policy; /* the bucket to spill when the walk memory is exhausted, `largest` or `current` */
+    std::string walk_order; /* reorder the walk batches by `vertex` or by `pair`, the previous block then the current vertex, empty means no reorder */
+    size_t sort_min;        /* the batches of fewer walks are not reordered */
+    size_t tail_walks;      /* drain the last walks in the tail mode once fewer are left, 0 means never */
+    size_t thread_walks;    /* the memory walks of a thread in one block pair before they are spilled */
+    size_t block_walks;     /* the walks of the largest batch per thread */
+    std::string batch_sizing; /* size the walk batches `adaptive`ly from the measured steps per second, or keep them `fixed` */
 };
 
 #endif
@@ -1,8 +1,14 @@
 #ifndef _GRAPH_DRIVER_H_
 #define _GRAPH_DRIVER_H_
 
+#include <thread>
+#include <mutex>
+#include <atomic>
 #include "cache.hpp"
+#include "storage.hpp"
 #include "util/io.hpp"
+#include "util/compress.hpp"
+#include "util/timer.hpp"
 #include "api/graph_buffer.hpp"
 #include "api/types.hpp"
 #include "metrics/metrics.hpp"
@@ -10,22 +16,153 @@
 /** graph_driver
  * This file contribute to define the operations of how to read from disk
  * or how to write graph data into disk
+ *
+ * With several storage roots, each block is read from its own block file (see `graph_storage`), and the
+ * blocks of one schedule are read by one thread per storage root, so all the devices are read in parallel.
+ * The selective loads read their chunks from the same block files, a block is loaded whole the first time to place
+ * its block file.
  */
 
-class graph_driver {
+class graph_driver : public block_loader {
 private:
     int vertdesc, edgedesc, degdesc, whtdesc;  /* the beg_pos, csr, degree file descriptor */
     metrics &_m;
     bool _weighted;
+    std::vector<uint8_t> chunk_buf;     /* the compressed walk chunks read from disk */
+    std::vector<uint32_t> decode_buf;   /* the decoded walk columns */
+    std::mutex pack_mtx;                /* the blocks of different storage roots are packed in parallel */
+    graph_storage storage;
+    std::mutex fd_mtx;                  /* the block files are opened by the on demand reads of any thread */
+    std::vector<int> block_fds;         /* the opened block files of the selectively loaded blocks, -1 if not opened */
+
+    /* the bytes of the block file of `block` */
+    size_t block_file_bytes(const block_t &block) {
+        size_t nbytes = (block.nverts + 1) * sizeof(eid_t) + block.nedges * sizeof(vid_t);
+        if(_weighted) nbytes += block.nedges * sizeof(real_t);
+        return nbytes;
+    }
+
+    /* load a block from the dataset files */
+    void load_dataset_block(cache_block &cblock, const block_t &block) {
+        load_block_vertex(vertdesc, cblock.beg_pos, block);
+        load_block_edge(edgedesc, cblock.csr, block);
+        if(_weighted) load_block_weight(whtdesc, cblock.weights, block);
+    }
+
+    /* load a block from its block file, the block file is created from the dataset files at the first time */
+    void load_striped_block(cache_block &cblock, const block_t &block) {
+        std::string name = storage.block_name(block.blk);
+        struct stat st;
+        off_t off = 0;
+        if(stat(name.c_str(), &st) == 0 && (size_t)st.st_size == block_file_bytes(block)) {
+            int fd = open(name.c_str(), O_RDONLY);
+            assert(fd >= 0);
+            load_block_range(fd, cblock.beg_pos, block.nverts + 1, off);
+            off += (block.nverts + 1) * sizeof(eid_t);
+            load_block_range(fd, cblock.csr, block.nedges, off);
+            off += block.nedges * sizeof(vid_t);
+            if(_weighted) load_block_range(fd, cblock.weights, block.nedges, off);
+            close(fd);
+            return;
+        }
+
+        load_dataset_block(cblock, block);
+        std::string tmp_name = name + ".tmp";
+        int fd = open(tmp_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+        assert(fd >= 0);
+        dump_block_range(fd, cblock.beg_pos, block.nverts + 1, off);
+        off += (block.nverts + 1) * sizeof(eid_t);
+        dump_block_range(fd, cblock.csr, block.nedges, off);
+        off += block.nedges * sizeof(vid_t);
+        if(_weighted) dump_block_range(fd, cblock.weights, block.nedges, off);
+        close(fd);
+        rename(tmp_name.c_str(), name.c_str());
+        logstream(LOG_DEBUG) << "place block " << block.blk << " into " << name << std::endl;
+    }
+
+    /* the descriptor of the block file of `block` on its storage root, -1 if the block file is not placed yet */
+    int block_file_desc(const block_t &block) {
+        std::lock_guard<std::mutex> lock(fd_mtx);
+        if(block_fds.size() <= block.blk) block_fds.resize(block.blk + 1, -1);
+        if(block_fds[block.blk] < 0) {
+            std::string name = storage.block_name(block.blk);
+            struct stat st;
+            if(stat(name.c_str(), &st) == 0 && (size_t)st.st_size == block_file_bytes(block)) block_fds[block.blk] = open(name.c_str(), O_RDONLY);
+        }
+        return block_fds[block.blk];
+    }
+
+    /* read the raw block into a staging slot of the cache, then encode the adjacency lists into the bit packed records of `cblock` */
+    void load_packed_block(graph_cache &cache, cache_block &cblock, const block_t &block) {
+        bid_t slot = cache.acquire_staging();
+        cache_block staging;
+        staging.beg_pos = cache.staging.beg_pos(slot);
+        staging.csr     = cache.staging.csr(slot);
+        staging.weights = cache.staging.weights(slot);
+        if(storage.striped()) load_striped_block(staging, block);
+        else load_dataset_block(staging, block);
+        const eid_t *beg_pos = staging.beg_pos;
+        const vid_t *csr = staging.csr;
+
+        graph_timer t;
+        t.start_time();
+        uint32_t off = 0;
+        for(vid_t v = 0; v < block.nverts; v++) {
+            cblock.offsets[v] = off;
+            off += bitpack_encode(csr + (beg_pos[v] - block.start_edge), beg_pos[v + 1] - beg_pos[v], cblock.packed + off);
+        }
+        cblock.offsets[block.nverts] = off;
+        memset(cblock.packed + off, 0, BITPACK_PADDING);
+        cache.release_staging(slot);
+        __sync_fetch_and_add(&packed_loads, 1);
+        __sync_fetch_and_add(&packed_bytes, (size_t)off);
+        std::lock_guard<std::mutex> lock(pack_mtx);
+        pack_time += t.runtime();
+    }
+
+    /* load the block `block_index` into the cache block `cache_index`, the caller takes care of the metrics */
+    void load_block_data(graph_cache &cache, graph_block *global_blocks, bid_t cache_index, bid_t block_index)
+    {
+        cache.cache_blocks[cache_index].block = &global_blocks->blocks[block_index];
+        cache.cache_blocks[cache_index].block->status = ACTIVE;
+        cache.cache_blocks[cache_index].block->cache_index = cache_index;
+        cache.cache_blocks[cache_index].sparse = false;
+
+        /* another job has loaded the block into the shared cache */
+        if(!cache.bind(cache_index, block_index)) return;
+
+        /* the beg_pos, csr and weights extents of the cache block are reserved in the arena, no reallocation */
+        if(cache.cache_blocks[cache_index].packed) load_packed_block(cache, cache.cache_blocks[cache_index], global_blocks->blocks[block_index]);
+        else if(storage.striped()) load_striped_block(cache.cache_blocks[cache_index], global_blocks->blocks[block_index]);
+        else load_dataset_block(cache.cache_blocks[cache_index], global_blocks->blocks[block_index]);
+        cache.publish(cache_index);
+
+#ifdef PROF_METRIC
+        cache.cache_blocks[cache_index].block->update_loaded_count();
+#endif
+    }
+
 public:
+    size_t sparse_loads, sparse_reads, sparse_bytes;  /* the selective block loads, their reads and bytes */
+    size_t packed_loads, packed_bytes;                /* the bit packed block loads and their record bytes */
+    double pack_time;                                 /* the seconds to encode the bit packed blocks */
+
     graph_driver(graph_config *conf, metrics &m) : _m(m)
     {
         vertdesc = edgedesc = whtdesc = 0;
+        _weighted = false;
+        sparse_loads = sparse_reads = sparse_bytes = 0;
+        packed_loads = packed_bytes = 0;
+        pack_time = 0.0;
         this->setup(conf);
     }
 
     graph_driver(metrics &m) : _m(m) {
         vertdesc = edgedesc = whtdesc = 0;
+        _weighted = false;
+        sparse_loads = sparse_reads = sparse_bytes = 0;
+        packed_loads = packed_bytes = 0;
+        pack_time = 0.0;
     }
 
     void setup(graph_config *conf) {
@@ -44,6 +181,7 @@ public:
             std::string weight_name = get_weights_name(conf->base_name);
             if(test_exists(weight_name)) whtdesc = open(weight_name.c_str(), O_RDONLY);
         }
+        storage.setup(*conf);
     }
 
     void load_block_info(graph_cache &cache, graph_block *global_blocks, bid_t cache_index, bid_t block_index)
@@ -52,28 +190,124 @@ public:
 #ifdef PROF_STEPS
         std::cout << "run_steps_load_block_info" << std::endl;
 #endif
-        cache.cache_blocks[cache_index].block = &global_blocks->blocks[block_index];
-        cache.cache_blocks[cache_index].block->status = ACTIVE;
-        cache.cache_blocks[cache_index].block->cache_index = cache_index;
+        load_block_data(cache, global_blocks, cache_index, block_index);
+        _m.stop_time("load_block_info");
+    }
+
+    /**
+     * load the blocks of `loads`, each is a (cache index, block index) pair. the blocks on different
+     * storage roots are loaded in parallel.
+     */
+    void load_blocks(graph_cache &cache, graph_block *global_blocks, const std::vector<std::pair<bid_t, bid_t>> &loads)
+    {
+        if(loads.empty()) return;
+        if(!storage.striped() || storage.nroots() == 1 || loads.size() == 1) {
+            for(const auto &load : loads) load_block_info(cache, global_blocks, load.first, load.second);
+            return;
+        }
+
+        _m.start_time("load_block_info");
+        std::vector<std::vector<std::pair<bid_t, bid_t>>> root_loads(storage.nroots());
+        for(const auto &load : loads) root_loads[storage.block_root(load.second)].push_back(load);
+        std::vector<std::thread> readers;
+        for(auto &rloads : root_loads) {
+            if(rloads.empty()) continue;
+            readers.emplace_back([this, &cache, global_blocks, &rloads]() {
+                for(const auto &load : rloads) load_block_data(cache, global_blocks, load.first, load.second);
+            });
+        }
+        for(auto &reader : readers) reader.join();
+        _m.stop_time("load_block_info");
+    }
 
-        cache.cache_blocks[cache_index].beg_pos = (eid_t *)realloc(cache.cache_blocks[cache_index].beg_pos, (global_blocks->blocks[block_index].nverts + 1) * sizeof(eid_t));
-        // cache.cache_blocks[cache_index].csr = (vid_t *)realloc(cache.cache_blocks[cache_index].csr, global_blocks->blocks[block_index].nedges * sizeof(vid_t));
+    /* load the blocks of `loads` with `nthreads` parallel readers, used to warm up the cache before the first schedule */
+    void preload_blocks(graph_cache &cache, graph_block *global_blocks, const std::vector<std::pair<bid_t, bid_t>> &loads, tid_t nthreads)
+    {
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> readers;
+        for(tid_t t = 0; t < std::min<size_t>(nthreads, loads.size()); t++) {
+            readers.emplace_back([this, &cache, global_blocks, &loads, &next]() {
+                for(size_t i = next++; i < loads.size(); i = next++) load_block_data(cache, global_blocks, loads[i].first, loads[i].second);
+            });
+        }
+        for(auto &reader : readers) reader.join();
+    }
 
-        load_block_vertex(vertdesc, cache.cache_blocks[cache_index].beg_pos, global_blocks->blocks[block_index]);
-        load_block_edge(edgedesc, cache.cache_blocks[cache_index].csr, global_blocks->blocks[block_index]);
+    /**
+     * load the block `block_index` selectively into the cache block `cache_index`, only the chunks of `verts`
+     * (sorted global vertex ids) are read, the nearby chunks are coalesced into one read.
+     */
+    void load_block_sparse(graph_cache &cache, graph_block *global_blocks, bid_t cache_index, bid_t block_index, const std::vector<vid_t> &verts)
+    {
+        _m.start_time("load_block_sparse");
+        cache_block &cblock = cache.cache_blocks[cache_index];
+        const block_t &block = global_blocks->blocks[block_index];
+        cblock.block = &global_blocks->blocks[block_index];
+        cblock.block->status = ACTIVE;
+        cblock.block->cache_index = cache_index;
+        cblock.sparse = true;
+        cblock.loader = this;
 
-        if(_weighted) {
-            cache.cache_blocks[cache_index].weights = (real_t *)realloc(cache.cache_blocks[cache_index].weights, global_blocks->blocks[block_index].nedges * sizeof(real_t));
-            load_block_weight(whtdesc, cache.cache_blocks[cache_index].weights, global_blocks->blocks[block_index]);
+        /* the block file is not placed on its storage root yet, load the whole block once to place it */
+        if(storage.striped() && block_file_desc(block) < 0) {
+            cblock.sparse = false;
+            load_striped_block(cblock, block);
+            _m.stop_time("load_block_sparse");
+            return;
         }
 
+        vid_t nchunks = (block.nverts + SPARSE_CHUNK - 1) / SPARSE_CHUNK;
+        for(vid_t c = 0; c < nchunks; c++) cblock.resident[c].store(0, std::memory_order_relaxed);
+
+        std::vector<vid_t> chunks;
+        for(vid_t v : verts) {
+            vid_t c = (v - block.start_vert) / SPARSE_CHUNK;
+            if(chunks.empty() || chunks.back() != c) chunks.push_back(c);
+        }
+        size_t index = 0;
+        while(index < chunks.size()) {
+            vid_t first = chunks[index], last = first;
+            while(index + 1 < chunks.size() && chunks[index + 1] - last <= SPARSE_GAP) last = chunks[++index];
+            index++;
+            load_vertex_range(cblock, first * SPARSE_CHUNK, std::min((last + 1) * SPARSE_CHUNK, block.nverts));
+            for(vid_t c = first; c <= last; c++) cblock.resident[c].store(1, std::memory_order_relaxed);
+        }
+        __sync_fetch_and_add(&sparse_loads, 1);
+
 #ifdef PROF_METRIC
-        cache.cache_blocks[cache_index].block->update_loaded_count();
+        cblock.block->update_loaded_count();
 #endif
-        _m.stop_time("load_block_info");
+        _m.stop_time("load_block_sparse");
+    }
+
+    /* read beg_pos[first, last] and the adjacency lists of the vertex range [first, last) of the block, from its block file or the dataset files */
+    void load_vertex_range(cache_block &cblock, vid_t first, vid_t last)
+    {
+        const block_t &block = *cblock.block;
+        int fd = storage.striped() ? block_file_desc(block) : -1;
+        off_t csr_off = (block.nverts + 1) * sizeof(eid_t), wht_off = csr_off + block.nedges * sizeof(vid_t);
+        if(fd >= 0) load_block_range(fd, cblock.beg_pos + first, last - first + 1, first * sizeof(eid_t));
+        else load_block_range(vertdesc, cblock.beg_pos + first, last - first + 1, (block.start_vert + first) * sizeof(eid_t));
+        size_t nbytes = (last - first + 1) * sizeof(eid_t);
+        eid_t head = cblock.beg_pos[first], tail = cblock.beg_pos[last];
+        if(tail > head) {
+            eid_t off = head - block.start_edge;
+            if(fd >= 0) load_block_range(fd, cblock.csr + off, tail - head, csr_off + off * sizeof(vid_t));
+            else load_block_range(edgedesc, cblock.csr + off, tail - head, head * sizeof(vid_t));
+            nbytes += (tail - head) * sizeof(vid_t);
+            if(_weighted) {
+                if(fd >= 0) load_block_range(fd, cblock.weights + off, tail - head, wht_off + off * sizeof(real_t));
+                else load_block_range(whtdesc, cblock.weights + off, tail - head, head * sizeof(real_t));
+                nbytes += (tail - head) * sizeof(real_t);
+            }
+        }
+        __sync_fetch_and_add(&sparse_reads, 1);
+        __sync_fetch_and_add(&sparse_bytes, nbytes);
     }
 
     void destory() {
+        for(int fd : block_fds) if(fd >= 0) close(fd);
+        block_fds.clear();
         if(vertdesc > 0) close(vertdesc);
         if(edgedesc > 0) close(edgedesc);
         if(_weighted) {
@@ -106,10 +340,41 @@ public:
     }
 
     template<typename walk_data_t>
-    void load_walk(int fd, size_t cnt, size_t loaded_cnt, graph_buffer<walk_data_t> &walks) {
-        off_t off = loaded_cnt * sizeof(walk_data_t);
+    size_t load_walk(int fd, size_t cnt, off_t &off, graph_buffer<walk_data_t> &walks) {
         load_block_range(fd, walks.buffer_begin(), cnt, off);
         walks.set_size(cnt);
+        off += cnt * sizeof(walk_data_t);
+        return cnt;
+    }
+
+    /**
+     * load the compressed walk chunks start from `off`, stop before the chunk that would exceed `cnt` walks, the
+     * first chunk is always loaded whole so the caller makes progress. each pread reads a chunk payload together
+     * with the next chunk header.
+     */
+    size_t load_walk(int fd, size_t cnt, off_t &off, graph_buffer<walker_t> &walks, const block_t &prev_block, const block_t &cur_block) {
+        walks.clear();
+        off_t fsize = lseek(fd, 0, SEEK_END);
+        if(off >= fsize) return 0;
+
+        walk_chunk_t head;
+        load_block_range(fd, &head, 1, off);
+        while(walks.size() == 0 || walks.size() + head.nwalks <= cnt) {
+            assert(!walks.test_overflow(head.nwalks));
+            bool has_next = off + (off_t)sizeof(walk_chunk_t) + head.nbytes < fsize;
+            size_t nread = head.nbytes + (has_next ? sizeof(walk_chunk_t) : 0);
+            if(chunk_buf.size() < nread + CODEC_PADDING) chunk_buf.resize(nread + CODEC_PADDING);
+            if(decode_buf.size() < WALK_COLUMNS * head.nwalks) decode_buf.resize(WALK_COLUMNS * head.nwalks);
+            load_block_range(fd, chunk_buf.data(), nread, off + sizeof(walk_chunk_t));
+
+            decode_walk_chunk(chunk_buf.data(), head.nwalks, prev_block.blk, prev_block.start_vert, cur_block.blk, cur_block.start_vert, decode_buf.data(), walks.buffer_begin() + walks.size());
+            walks.set_size(walks.size() + head.nwalks);
+            off += sizeof(walk_chunk_t) + head.nbytes;
+
+            if(!has_next) break;
+            memcpy(&head, chunk_buf.data() + head.nbytes, sizeof(walk_chunk_t));
+        }
+        return walks.size();
     }
 
     template<typename walk_data_t>
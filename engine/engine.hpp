@@ -4,6 +4,8 @@
 #include <functional>
 #include "cache.hpp"
 #include "schedule.hpp"
+#include "reader.hpp"
+#include "checkpoint.hpp"
 #include "util/timer.hpp"
 #include "metrics/metrics.hpp"
 #include "apps/secondorder.hpp"
@@ -20,6 +22,9 @@ public:
 
     // statistic metric
     metrics &_m;
+    graph_timer first_step_timer;       /* the time from the prologue to the first walk step */
+    batch_sizer batch;                  /* the size of the walk batches */
+    bool stepped;
 
 #ifdef PROF_STEPS
     size_t total_times;
@@ -34,6 +39,7 @@ public:
         conf          = &_conf;
         // seeds = std::vector<unsigned int>(conf->nthreads);
         seeds = std::vector<RandNum>(conf->nthreads, RandNum(9898676785859));
+        stepped = false;
         for(tid_t tid = 0; tid < conf->nthreads; tid++) {
             seeds[tid] = time(NULL) + tid;
         }
@@ -46,15 +52,45 @@ public:
     }
 
     void prologue(second_order_app_t &userprogram, std::function<void(graph_walk *)> init_func = nullptr)
+    {
+        start(userprogram);
+        /* the walks will be restored from the checkpoint at the beginning of `run` */
+        if(walk_manager->resumed) init_func = nullptr;
+        userprogram.prologue(walk_manager, init_func);
+        walk_manager->publish();
+    }
+
+    /* the start walks of `source` are generated block by block when the scheduler first runs the blocks */
+    void prologue(second_order_app_t &userprogram, walk_source *source)
+    {
+        start(userprogram, source->nids());
+        userprogram.prologue(walk_manager, source);
+    }
+
+    /* `nids` is the number of walk ids the app hands out, 0 if unknown */
+    void start(second_order_app_t &userprogram, uint64_t nids = 0)
     {
         logstream(LOG_INFO) << "  =================  STARTED  ======================  " << std::endl;
         logstream(LOG_INFO) << "Random walks, random generate " << userprogram.get_numsources() << " walks on whole graph, exec_threads = " << conf->nthreads << std::endl;
         logstream(LOG_INFO) << "vertices : " << conf->nvertices << ", edges : " << conf->nedges << std::endl;
         srand(time(0));
 
+        if(!walker_layout.setup(conf->nvertices, userprogram.get_hops())) {
+            logstream(LOG_FATAL) << conf->nvertices << " vertices and " << userprogram.get_hops() << " hops leave no bits for the walk id in a walker of " << sizeof(walker_t) << " bytes" << std::endl;
+            assert(false);
+        }
+        logstream(LOG_INFO) << "walker : " << sizeof(walker_t) << " bytes, " << walker_layout.vertex_bits << " vertex bits, " << walker_layout.hop_bits << " hop bits, " << walker_layout.id_bits << " id bits" << std::endl;
+        if(walker_layout.id_bits < 64 && nids > (1ULL << walker_layout.id_bits)) {
+            logstream(LOG_FATAL) << nids << " walks need more than the " << walker_layout.id_bits << " id bits of the walker, build with WIDE_WALK_ID" << std::endl;
+            assert(false);
+        }
+        if(nids == 0 && walker_layout.id_bits < 8 * sizeof(wid_t)) logstream(LOG_WARNING) << "the walk ids above 2^" << walker_layout.id_bits << " - 1 do not fit the walker, build with WIDE_WALK_ID" << std::endl;
+        _m.set("walker_bytes", sizeof(walker_t));
+        walk_manager->hops = userprogram.get_hops();
+
         omp_set_num_threads(conf->nthreads);
         _m.start_time("run_app");
-        userprogram.prologue(walk_manager, init_func);
+        first_step_timer.start_time();
     }
 
     void run(second_order_app_t &userprogram, scheduler *block_scheduler)
@@ -63,14 +99,33 @@ public:
         logstream(LOG_INFO) << "Random walks start executing, please wait for a minute." << std::endl;
         gtimer.start_time();
         int run_count = 0;
-        wid_t interval_max_walks = conf->max_nthreads * MAX_TWALKS * 5;
+        size_t tail_rounds = 0;
         bid_t nblocks = walk_manager->nblocks;
+        batch.setup(*conf);
+        graph_walk_reader reader(walk_manager, max_batch_walks(*conf));
+        graph_checkpoint checkpoint(conf, walk_manager);
+        if(walk_manager->resumed) run_count = checkpoint.restore(seeds, *block_scheduler);
+        preload();
         while(!walk_manager->test_finished_walks()) {
             wid_t total_walks = walk_manager->nwalks();
             logstream(LOG_DEBUG) << "run time : " << gtimer.runtime() << std::endl;
             logstream(LOG_DEBUG) << "run_count = " << run_count << ", total walks = " << total_walks << std::endl;
             cache->walk_blocks.clear();
-            block_scheduler->schedule(*cache, *driver, *walk_manager);
+            if(!cache->tail && total_walks < conf->tail_walks) {
+                cache->tail = true;
+                _m.set("tail_start_walks", (size_t)total_walks);
+                logstream(LOG_INFO) << "enter the tail mode, " << total_walks << " walks left" << std::endl;
+            }
+            if(cache->tail) {
+                tail_rounds++;
+                block_scheduler->tail_schedule(*cache, *driver, *walk_manager);
+            } else {
+                block_scheduler->schedule(*cache, *driver, *walk_manager);
+            }
+            /* the memory walks of one block pair, at most `nthreads * thread_walks`, always fit into one batch */
+            wid_t interval_max_walks = batch.size(), resident_walks = 0;
+            for(bid_t blk : cache->walk_blocks) resident_walks += walk_manager->nblockwalks(blk);
+            reader.set_max_walks(interval_max_walks);
             size_t pos = 0;
             logstream(LOG_DEBUG) << "cache walk block size : " << cache->walk_blocks.size() << std::endl;
             std::cout << "cache index : ";
@@ -78,40 +133,170 @@ public:
                 std::cout << (*(walk_manager->global_blocks))[blk].cache_index << " ";
             }
             std::cout << std::endl;
+            /* the walks can not move into the scheduled pairs, so the disk walks can be read along with the memory walks */
+            if(userprogram.continue_update) reader.start(cache->walk_blocks, true);
             while(pos < cache->walk_blocks.size()) {
                 wid_t nwalks = 0;
                 walk_manager->walks.clear();
-                while(pos < cache->walk_blocks.size() && nwalks + walk_manager->nmwalks(cache->walk_blocks[pos]) <= interval_max_walks) {
-                    nwalks += walk_manager->nmwalks(cache->walk_blocks[pos]);
-                    walk_manager->load_memory_walks(cache->walk_blocks[pos]);
+                while(pos < cache->walk_blocks.size() && (nwalks == 0 || nwalks + walk_manager->nmwalks(cache->walk_blocks[pos]) <= interval_max_walks)) {
+                    bid_t exec_block = cache->walk_blocks[pos];
+                    nwalks += walk_manager->nmwalks(exec_block);
+                    walk_manager->load_memory_walks(exec_block);
+                    /* the lazy start walks fill the rest of the batch, the batch is full if some are left */
+                    nwalks += walk_manager->load_source_walks(exec_block, interval_max_walks - nwalks);
+                    if(walk_manager->nvwalks(exec_block) > 0) break;
                     pos++;
                 }
                 update_walk(userprogram, nwalks);
                 logstream(LOG_DEBUG) << "load memory walks, pos = " << pos << ", walks = " << nwalks << std::endl;
             }
-            pos = 0;
-            while (pos < cache->walk_blocks.size()) {
-                wid_t num_disk_walks = walk_manager->ndwalks(cache->walk_blocks[pos]), disk_load_walks = 0;
-                while(num_disk_walks > 0){
-                    wid_t interval_walks = std::min(num_disk_walks, interval_max_walks);
-                    num_disk_walks -= interval_walks;
-                    wid_t nwalks = walk_manager->load_disk_walks(cache->walk_blocks[pos], interval_walks, disk_load_walks);
-                    disk_load_walks += interval_walks;
-                    update_walk(userprogram, nwalks);
-                    logstream(LOG_DEBUG) << "load disk walks from " << cache->walk_blocks[pos] / nblocks << " to " << cache->walk_blocks[pos] % nblocks << ", walks = " << nwalks << std::endl;
-                }
-                walk_manager->dump_walks(cache->walk_blocks[pos]);
-                pos++;
+            if(!userprogram.continue_update) reader.start(cache->walk_blocks, false);
+            bid_t exec_block;
+            bool last_batch;
+            _m.start_time("wait_disk_walks");
+            while (reader.next(walk_manager->walks, exec_block, last_batch)) {
+                _m.stop_time("wait_disk_walks");
+                wid_t nwalks = walk_manager->walks.size();
+                update_walk(userprogram, nwalks);
+                reader.done(last_batch);
+                logstream(LOG_DEBUG) << "load disk walks from " << exec_block / nblocks << " to " << exec_block % nblocks << ", walks = " << nwalks << std::endl;
+                _m.start_time("wait_disk_walks");
             }
+            _m.stop_time("wait_disk_walks");
+            reader.finish();
+            walk_manager->pool.trim();
+            batch.adjust(resident_walks);
+            _m.start_time("hub_refresh");
+            cache->hubs.refresh();
+            _m.stop_time("hub_refresh");
             run_count++;
+            if(conf->checkpoint > 0 && run_count % conf->checkpoint == 0 && !walk_manager->test_finished_walks()) {
+                _m.start_time("checkpoint");
+                checkpoint.dump(seeds, *block_scheduler, run_count);
+                _m.stop_time("checkpoint");
+            }
         }
+        checkpoint.remove();
+        _m.set("tail_rounds", tail_rounds);
+        _m.set("batch_walks", (size_t)batch.size());
+        _m.set("batch_peak_walks", (size_t)batch.peak);
+        _m.set("batch_resizes", batch.nresizes);
+        if(conf->preload == "snapshot") dump_snapshot();
         logstream(LOG_DEBUG) << gtimer.runtime() << "s, total run count : " << run_count << std::endl;
     }
 
+    /**
+     * load the blocks resident at the exit of the last run (`snapshot`), then the blocks with the most pending walks,
+     * up to the cache size, with parallel reads, so the first schedule finds them in the cache
+     */
+    void preload()
+    {
+        if(conf->preload.empty()) return;
+        _m.start_time("preload");
+        bid_t nblocks = walk_manager->nblocks;
+        std::vector<bool> planned(nblocks, false);
+        std::vector<bid_t> plan;
+        std::string snapshot_name = get_cache_snapshot_name(conf->base_name, conf->blocksize);
+        if(conf->preload == "snapshot" && test_exists(snapshot_name)) {
+            for(bid_t blk : load_graph_blocks<bid_t>(snapshot_name)) {
+                if(blk < nblocks && !planned[blk]) {
+                    planned[blk] = true;
+                    plan.push_back(blk);
+                }
+            }
+        } else if(conf->preload != "snapshot" && conf->preload != "walks") {
+            logstream(LOG_WARNING) << "unknown preload " << conf->preload << ", use walks" << std::endl;
+        }
+
+        std::vector<wid_t> partition_walks(nblocks, 0);
+        for(bid_t blk = 0; blk < nblocks * nblocks; blk++) {
+            wid_t nwalks = walk_manager->nblockwalks(blk);
+            partition_walks[blk / nblocks] += nwalks;
+            if(blk / nblocks != blk % nblocks) partition_walks[blk % nblocks] += nwalks;
+        }
+        std::vector<bid_t> order(nblocks);
+        for(bid_t blk = 0; blk < nblocks; blk++) order[blk] = blk;
+        std::stable_sort(order.begin(), order.end(), [&partition_walks](bid_t u, bid_t v) { return partition_walks[u] > partition_walks[v]; });
+        for(bid_t blk : order) {
+            if(!planned[blk] && partition_walks[blk] > 0) plan.push_back(blk);
+        }
+        if(plan.size() > cache->ncblock) plan.resize(cache->ncblock);
+
+        std::vector<std::pair<bid_t, bid_t>> loads;
+        std::vector<bool> pinned(nblocks, false);
+        for(bid_t blk : plan) {
+            if((*(walk_manager->global_blocks))[blk].cache_index != nblocks) continue;
+            loads.push_back(std::make_pair(cache->miss(blk, pinned), blk));
+        }
+        driver->preload_blocks(*cache, walk_manager->global_blocks, loads, conf->nthreads);
+        _m.stop_time("preload");
+        _m.set("preload_blocks", loads.size());
+        logstream(LOG_INFO) << "preload " << loads.size() << " blocks" << std::endl;
+    }
+
+    /* record the resident blocks for the preload of the next run */
+    void dump_snapshot()
+    {
+        std::vector<bid_t> resident;
+        for(bid_t p = 0; p < cache->ncblock; p++) {
+            if(cache->cache_blocks[p].block != NULL) resident.push_back(cache->cache_blocks[p].block->blk);
+        }
+        std::string name = get_cache_snapshot_name(conf->base_name, conf->blocksize);
+        test_delete(name);
+        if(!resident.empty()) appendfile(name, resident.data(), resident.size());
+    }
+
     void epilogue(second_order_app_t &userprogram)
     {
         userprogram.epilogue();
         _m.stop_time("run_app");
+        if(walk_manager->source) _m.set("source_walks", (size_t)walk_manager->source->total_generated());
+        _m.set("spill_walks", walk_manager->spill_walks);
+        _m.set("spill_bytes", walk_manager->spill_bytes);
+        _m.set("walk_pool_peak_bytes", walk_manager->pool.peak_bytes());
+        _m.set("walk_pool_allocated_bytes", walk_manager->pool.allocated_bytes());
+        _m.set("walk_pool_released_bytes", walk_manager->pool.released_bytes());
+        _m.set("walk_pool_spills", walk_manager->pool_spills);
+        _m.set("walk_pool_overdrafts", walk_manager->pool.noverdrafts);
+        _m.set("sorted_batches", walk_manager->sorted_batches);
+        _m.set("hugepage_alloc_bytes", huge_allocator.alloc_bytes);
+        _m.set("hugepage_bytes", huge_allocator.resident_bytes());
+        _m.set("arena_bytes", cache->arena.total_bytes);
+        _m.set("arena_prefault_time", cache->arena.prefault_time);
+        _m.set("cache_hits", cache->nhits);
+        _m.set("cache_misses", cache->nmisses);
+        _m.set("sparse_loads", driver->sparse_loads);
+        _m.set("sparse_reads", driver->sparse_reads);
+        _m.set("sparse_bytes", driver->sparse_bytes);
+        _m.set("packed_loads", driver->packed_loads);
+        _m.set("packed_bytes", driver->packed_bytes);
+        _m.set("pack_time", driver->pack_time);
+        _m.set("packed_ratio", cache->packed_ratio);
+        _m.set("shared_slots", cache->shared.nslots());
+        _m.set("shared_attaches", cache->shared.nattaches);
+        _m.set("shared_loads", cache->shared.nloads);
+        _m.set("shared_fallbacks", cache->shared.nfallbacks);
+        _m.set("hub_vertices", cache->hubs.nhubs());
+        _m.set("hub_bytes", cache->hubs.bytes());
+        _m.set("hub_hits", cache->hubs.nhits());
+        _m.set("hub_stalls", cache->hubs.nstalls);
+        _m.set("hub_reads", cache->hubs.nreads);
+        _m.set("hub_refreshes", cache->hubs.nrefreshes);
+        _m.set("tail_reads", cache->direct.nreads);
+        _m.set("tail_bytes", cache->direct.nbytes);
+        if(walk_manager->trajectory) {
+            _m.set("trajectory_records", walk_manager->trajectory->total_records());
+            _m.start_time("merge_trajectory");
+            walk_manager->trajectory->merge(conf->trajectory, conf->trajectory_text);
+            _m.stop_time("merge_trajectory");
+        }
+        if(walk_manager->stream) {
+            _m.start_time("stream_drain");
+            walk_manager->stream->close();
+            _m.stop_time("stream_drain");
+            _m.set("stream_records", walk_manager->stream->total_records());
+            _m.set("stream_stalls", walk_manager->stream->total_stalls());
+        }
 #ifdef PROF_STEPS
         std::cout << "each walk step : " << sum_avg_steps / total_times << std::endl;
 #endif
@@ -120,21 +305,30 @@ public:
 
     void update_walk(second_order_app_t &userprogram, wid_t nwalks)
     {
+        if(!stepped) {
+            stepped = true;
+            _m.set("time_to_first_step", first_step_timer.runtime());
+            logstream(LOG_INFO) << "time to first step : " << first_step_timer.runtime() << "s" << std::endl;
+        }
         if(nwalks < 100) omp_set_num_threads(1);
         else omp_set_num_threads(conf->nthreads);
 
         _m.start_time("exec_block_walk");
         {
-            // wid_t run_steps = 0;
-            // #pragma omp parallel for reduction(+: run_steps)
-            // for(wid_t idx = 0; idx < nwalks; idx++) {
-            //     run_steps += userprogram.update_walk(walk_manager->walks[idx], cache, walk_manager, sampler, &seeds[omp_get_thread_num()]);
-            // }
             logstream(LOG_INFO) << gtimer.runtime() << "s, nwalks : " << nwalks << std::endl;
-            #pragma omp parallel for schedule(dynamic)
+            graph_timer batch_timer;
+            batch_timer.start_time();
+            _m.start_time("sort_walks");
+            walk_manager->sort_walks();
+            _m.stop_time("sort_walks");
+            wid_t run_steps = 0;
+            #pragma omp parallel for schedule(dynamic) reduction(+: run_steps)
             for(wid_t idx = 0; idx < nwalks; idx++) {
-                userprogram.update_walk(walk_manager->walks[idx], cache, walk_manager, &seeds[omp_get_thread_num()]);
+                run_steps += userprogram.update_walk(walk_manager->walks[idx], cache, walk_manager, &seeds[omp_get_thread_num()]);
             }
+            if(walk_manager->stream) walk_manager->stream->flush();
+            walk_manager->publish();
+            batch.record(nwalks, run_steps, batch_timer.runtime());
 #ifdef PROF_STEPS
             total_times++;
             sum_avg_steps += (double)run_steps / nwalks;
@@ -0,0 +1,263 @@
+#ifndef _GRAPH_HUB_H_
+#define _GRAPH_HUB_H_
+
+#include <omp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "api/types.hpp"
+#include "util/util.hpp"
+#include "util/io.hpp"
+#include "logger/logger.hpp"
+#include "config.hpp"
+
+/** graph_hub
+ *
+ * This file contribute to define the pinned adjacency cache of the hot vertices. A memory slice of `hub_size` bytes
+ * holds the adjacency lists of the top vertices and survives the block swaps, so a walk at a hub keeps stepping
+ * although the block of the hub is not cached:
+ *
+ * | ids (sorted hubs) | offsets (nhubs + 1) | adjacency lists of the hubs | hub bitmap (nvertices bits) |
+ *
+ * `degree` : rank the vertices by in-degree, counted once from the csr file
+ * `visits` : start from the in-degree ranking, then re-rank after each round by the uses of the hubs and the stalls
+ *            of the walks at the vertices of uncached blocks, the counts are halved each round
+ *
+ * The selection never sorts all the ranked vertices, it orders a window of the top candidates at a time and reads
+ * their adjacency ranges from the beg_pos file in runs of close vertices, the new hubs adjacent in the csr file are
+ * loaded with one read. The in-degree is counted with a sequential pass over the csr file at the setup.
+ *
+ * The hubs hold no edge weights, the walk update code only samples from the adjacency lists.
+ */
+
+#define HUB_MAX_MISFITS 64   /* stop the selection after this many consecutive candidates do not fit the budget */
+#define HUB_READ_GAP 512     /* the candidates at most this many vertices apart share one read of the beg_pos */
+
+class graph_hub {
+private:
+    std::vector<vid_t> ids;                     /* the hub vertices, sorted */
+    std::vector<eid_t> offsets;                 /* the adjacency of ids[i] is adj[offsets[i], offsets[i + 1]) */
+    std::vector<vid_t> adj;
+    std::vector<uint64_t> bitmap;               /* a fast negative test before the binary search in `ids` */
+    std::vector<uint32_t> score;                /* the visit counts of the vertices, only for the `visits` rank */
+    std::vector<std::vector<size_t>> uses;      /* the uses of each hub, per thread */
+    size_t past_hits;                           /* the uses of the replaced hubs */
+    size_t round_stalls;                        /* the stalls before the last round */
+    eid_t avg_degree;                           /* sizes the first selection window */
+    int vertdesc, edgedesc;
+
+    struct candidate {
+        vid_t v;
+        eid_t head, deg;
+    };
+
+    static size_t hub_cost(eid_t deg) { return sizeof(vid_t) + sizeof(eid_t) + deg * sizeof(vid_t); }
+
+    bool test_hub(vid_t v) const { return (bitmap[v >> 6] >> (v & 63)) & 1; }
+
+    /* count the in-degree of each vertex with one sequential pass over the csr file */
+    std::vector<uint32_t> count_indegree(eid_t nedges) {
+        std::vector<uint32_t> indeg(nvertices, 0);
+        const eid_t chunk = 16 * 1024 * 1024;
+        std::vector<vid_t> buf(std::min(chunk, nedges));
+        for(eid_t pos = 0; pos < nedges; pos += chunk) {
+            eid_t count = std::min(chunk, nedges - pos);
+            load_block_range(edgedesc, buf.data(), count, pos * sizeof(vid_t));
+            for(eid_t e = 0; e < count; e++) indeg[buf[e]]++;
+        }
+        return indeg;
+    }
+
+    /* read the adjacency ranges of `cands`, the close vertices share one read of the beg_pos */
+    void locate(std::vector<candidate> &cands) {
+        std::vector<size_t> byvertex(cands.size());
+        for(size_t i = 0; i < cands.size(); i++) byvertex[i] = i;
+        std::sort(byvertex.begin(), byvertex.end(), [&cands](size_t a, size_t b) { return cands[a].v < cands[b].v; });
+        std::vector<eid_t> range;
+        for(size_t i = 0; i < byvertex.size(); ) {
+            size_t j = i + 1;
+            while(j < byvertex.size() && cands[byvertex[j]].v - cands[byvertex[j - 1]].v <= HUB_READ_GAP) j++;
+            vid_t first = cands[byvertex[i]].v;
+            range.resize(cands[byvertex[j - 1]].v - first + 2);
+            load_block_range(vertdesc, range.data(), range.size(), (size_t)first * sizeof(eid_t));
+            for(size_t k = i; k < j; k++) {
+                candidate &c = cands[byvertex[k]];
+                c.head = range[c.v - first];
+                c.deg = range[c.v - first + 1] - c.head;
+            }
+            i = j;
+        }
+    }
+
+    /**
+     * take the vertices greedily in the `rank` order while the budget allows. only a window of the top candidates
+     * is ordered at a time (nth_element then sort), the window starts at the hubs of an average degree that fill
+     * the budget and doubles while the budget is not full, so the whole `order` is never sorted.
+     */
+    template<typename Rank>
+    std::vector<candidate> select(std::vector<vid_t> &order, Rank rank) {
+        std::vector<candidate> chosen;
+        size_t used = 0, misfits = 0;
+        size_t window = std::max<size_t>(HUB_MAX_MISFITS, budget / hub_cost(avg_degree));
+        for(size_t pos = 0; pos < order.size() && misfits < HUB_MAX_MISFITS && used + hub_cost(0) <= budget; window *= 2) {
+            size_t end = pos + std::min(window, order.size() - pos);
+            if(end < order.size()) std::nth_element(order.begin() + pos, order.begin() + end, order.end(), rank);
+            std::sort(order.begin() + pos, order.begin() + end, rank);
+            std::vector<candidate> cands(end - pos);
+            for(size_t i = 0; i < cands.size(); i++) cands[i].v = order[pos + i];
+            locate(cands);
+            for(size_t i = 0; i < cands.size() && misfits < HUB_MAX_MISFITS; i++) {
+                if(used + hub_cost(cands[i].deg) > budget) {
+                    misfits++;
+                    continue;
+                }
+                misfits = 0;
+                used += hub_cost(cands[i].deg);
+                chosen.push_back(cands[i]);
+            }
+            pos = end;
+        }
+        std::sort(chosen.begin(), chosen.end(), [](const candidate &a, const candidate &b) { return a.v < b.v; });
+        return chosen;
+    }
+
+    /* replace the hubs by `chosen`, the lists of the kept hubs are copied instead of read again */
+    void install(const std::vector<candidate> &chosen) {
+        std::vector<vid_t> new_ids(chosen.size());
+        std::vector<eid_t> new_offsets(chosen.size() + 1, 0);
+        for(size_t i = 0; i < chosen.size(); i++) {
+            new_ids[i] = chosen[i].v;
+            new_offsets[i + 1] = new_offsets[i] + chosen[i].deg;
+        }
+        std::vector<vid_t> new_adj(new_offsets.back());
+        const vid_t *list;
+        eid_t deg;
+        for(size_t i = 0; i < chosen.size(); ) {
+            if(find_hub(chosen[i].v, list, deg) != ids.size()) {
+                std::copy(list, list + deg, new_adj.begin() + new_offsets[i]);
+                i++;
+                continue;
+            }
+            /* the new hubs with adjacent lists in the csr file are read at once */
+            size_t j = i + 1;
+            while(j < chosen.size() && chosen[j].head == chosen[j - 1].head + chosen[j - 1].deg && find_hub(chosen[j].v, list, deg) == ids.size()) j++;
+            eid_t count = new_offsets[j] - new_offsets[i];
+            if(count > 0) {
+                load_block_range(edgedesc, new_adj.data() + new_offsets[i], count, chosen[i].head * sizeof(vid_t));
+                nreads++;
+            }
+            i = j;
+        }
+        for(vid_t v : ids) bitmap[v >> 6] &= ~(1ULL << (v & 63));
+        for(vid_t v : new_ids) bitmap[v >> 6] |= 1ULL << (v & 63);
+        ids.swap(new_ids);
+        offsets.swap(new_offsets);
+        adj.swap(new_adj);
+        for(auto &u : uses) u.assign(ids.size(), 0);
+    }
+
+    /* the index of the hub `v` in `ids`, `ids.size()` if `v` is not a hub */
+    size_t find_hub(vid_t v, const vid_t *&list, eid_t &deg) const {
+        if(ids.empty() || !test_hub(v)) return ids.size();
+        size_t idx = std::lower_bound(ids.begin(), ids.end(), v) - ids.begin();
+        list = adj.data() + offsets[idx];
+        deg = offsets[idx + 1] - offsets[idx];
+        return idx;
+    }
+
+public:
+    size_t budget;              /* the bytes of the adjacency slice */
+    bool by_visits;
+    vid_t nvertices;
+    size_t nstalls, nreads, nrefreshes;
+
+    graph_hub() : past_hits(0), round_stalls(0), avg_degree(0), vertdesc(-1), edgedesc(-1), budget(0), by_visits(false), nvertices(0), nstalls(0), nreads(0), nrefreshes(0) { }
+
+    ~graph_hub() {
+        if(vertdesc >= 0) close(vertdesc);
+        if(edgedesc >= 0) close(edgedesc);
+    }
+
+    bool enabled() const { return !ids.empty(); }
+    size_t nhubs() const { return ids.size(); }
+    size_t bytes() const { return ids.size() * sizeof(vid_t) + offsets.size() * sizeof(eid_t) + adj.size() * sizeof(vid_t); }
+
+    size_t nhits() const {
+        size_t total = past_hits;
+        for(const auto &u : uses) for(size_t n : u) total += n;
+        return total;
+    }
+
+    void setup(graph_config *conf) {
+        if(conf->hub_size == 0) return;
+        nvertices = conf->nvertices;
+        by_visits = conf->hub_rank == "visits";
+        if(conf->hub_rank != "degree" && !by_visits) logstream(LOG_WARNING) << "unknown hub rank " << conf->hub_rank << ", use degree" << std::endl;
+        bitmap.assign((nvertices + 63) / 64, 0);
+        size_t overhead = bitmap.size() * sizeof(uint64_t);
+        if(conf->hub_size <= overhead) {
+            logstream(LOG_WARNING) << "hub size " << conf->hub_size << " can not hold the hub bitmap of " << overhead << " bytes, disable the hub cache" << std::endl;
+            return;
+        }
+        budget = conf->hub_size - overhead;
+        uses.resize(std::max(conf->max_nthreads, conf->nthreads));
+        vertdesc = open(get_beg_pos_name(conf->base_name).c_str(), O_RDONLY);
+        edgedesc = open(get_csr_name(conf->base_name).c_str(), O_RDONLY);
+        assert(vertdesc >= 0 && edgedesc >= 0);
+
+        avg_degree = nvertices > 0 ? conf->nedges / nvertices : 0;
+
+        std::vector<uint32_t> indeg = count_indegree(conf->nedges);
+        std::vector<vid_t> order;
+        for(vid_t v = 0; v < nvertices; v++) {
+            if(indeg[v] > 0) order.push_back(v);
+        }
+        install(select(order, [&indeg](vid_t u, vid_t v) { return indeg[u] > indeg[v] || (indeg[u] == indeg[v] && u < v); }));
+        if(by_visits) {
+            score.assign(nvertices, 0);
+            for(vid_t v : ids) score[v] = indeg[v];
+        }
+        logstream(LOG_INFO) << "hub cache : " << ids.size() << " hubs, " << bytes() << " bytes, rank by " << conf->hub_rank << std::endl;
+    }
+
+    /* the adjacency list of the hub `v`, false if `v` is not a hub */
+    bool find(vid_t v, const vid_t *&list, eid_t &deg) {
+        size_t idx = find_hub(v, list, deg);
+        if(idx == ids.size()) return false;
+        uses[omp_get_thread_num()][idx]++;
+        return true;
+    }
+
+    /* a walk stops at `v`, its block is not cached and it is not a hub */
+    void stall(vid_t v) {
+        if(budget == 0) return;
+        __sync_fetch_and_add(&nstalls, 1);
+        if(by_visits) __sync_fetch_and_add(&score[v], 1);
+    }
+
+    /* re-rank the hubs by the visits of the last round, called between the rounds */
+    void refresh() {
+        if(!by_visits || budget == 0) return;
+        /* keep the hubs of an idle round, the halved counts would wipe them out */
+        if(nstalls == round_stalls && nhits() == past_hits) return;
+        round_stalls = nstalls;
+        for(size_t i = 0; i < ids.size(); i++) {
+            size_t n = 0;
+            for(const auto &u : uses) n += u[i];
+            score[ids[i]] = (uint32_t)std::min<size_t>((size_t)score[ids[i]] + n, UINT32_MAX);
+        }
+        std::vector<vid_t> order;
+        for(vid_t v = 0; v < nvertices; v++) {
+            if(score[v] > 0) order.push_back(v);
+        }
+        std::vector<candidate> chosen = select(order, [this](vid_t u, vid_t v) { return score[u] > score[v] || (score[u] == score[v] && u < v); });
+        past_hits = nhits();
+        install(chosen);
+        for(vid_t v : order) score[v] >>= 1;
+        nrefreshes++;
+    }
+};
+
+#endif
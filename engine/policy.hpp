@@ -0,0 +1,189 @@
+#ifndef _GRAPH_POLICY_H_
+#define _GRAPH_POLICY_H_
+
+#include <list>
+#include <string>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include "api/types.hpp"
+#include "logger/logger.hpp"
+
+/** cache_policy
+ *
+ * This file contribute to define the replacement policies of the block cache, the schedulers decide which blocks
+ * are needed and the policy decides which resident block is evicted to make room for a missed block.
+ *
+ * `lru`    : evict the least recently used block
+ * `lfu`    : evict the least frequently used block, ties broken by recency
+ * `arc`    : adaptive replacement cache, balance recency and frequency with the ghost lists of evicted blocks
+ * `belady` : evict the block the scheduler's plan needs furthest in the future
+ *
+ * Each round, the cache calls `hit` for a needed resident block, and `miss`, then `victim` if no slot is
+ * free, then `evict` and `insert` for a missed block.
+ */
+
+class cache_policy {
+public:
+    virtual void hit(bid_t blk) = 0;
+    virtual void miss(bid_t blk) { }
+    virtual bid_t victim(const std::vector<bid_t> &resident) = 0;   /* choose one of the evictable resident blocks */
+    virtual void evict(bid_t blk) = 0;
+    virtual void insert(bid_t blk) = 0;
+    virtual void plan(const std::vector<bid_t> &sequence) { }       /* the future block accesses of the scheduler */
+    virtual ~cache_policy() { }
+};
+
+class lru_policy_t : public cache_policy {
+protected:
+    size_t clock;
+    std::vector<size_t> last_use;
+
+public:
+    lru_policy_t(bid_t nblocks) : clock(0), last_use(nblocks, 0) { }
+
+    void hit(bid_t blk) { last_use[blk] = ++clock; }
+
+    size_t last_used(bid_t blk) const { return last_use[blk]; }
+
+    bid_t victim(const std::vector<bid_t> &resident) {
+        return *std::min_element(resident.begin(), resident.end(), [this](bid_t u, bid_t v) { return last_use[u] < last_use[v]; });
+    }
+
+    void evict(bid_t blk) { }
+    void insert(bid_t blk) { last_use[blk] = ++clock; }
+};
+
+class lfu_policy_t : public lru_policy_t {
+private:
+    std::vector<size_t> freq;   /* the uses of each block, kept across evictions */
+
+public:
+    lfu_policy_t(bid_t nblocks) : lru_policy_t(nblocks), freq(nblocks, 0) { }
+
+    void hit(bid_t blk) { freq[blk]++; last_use[blk] = ++clock; }
+
+    bid_t victim(const std::vector<bid_t> &resident) {
+        return *std::min_element(resident.begin(), resident.end(), [this](bid_t u, bid_t v) {
+            return freq[u] < freq[v] || (freq[u] == freq[v] && last_use[u] < last_use[v]);
+        });
+    }
+
+    void insert(bid_t blk) { freq[blk]++; last_use[blk] = ++clock; }
+};
+
+class arc_policy_t : public cache_policy {
+private:
+    enum arc_list { NONE = 0, T1, T2, B1, B2 };
+    size_t capacity, target;            /* the cache size `c` and the target size `p` of T1 */
+    bid_t missed;                       /* the last missed block */
+    std::list<bid_t> lists[5];          /* front is the most recently used */
+    std::vector<arc_list> where;
+
+    void remove(bid_t blk) {
+        if(where[blk] != NONE) lists[where[blk]].remove(blk);
+        where[blk] = NONE;
+    }
+
+    void push(bid_t blk, arc_list l) {
+        remove(blk);
+        lists[l].push_front(blk);
+        where[blk] = l;
+    }
+
+    void trim(arc_list l, size_t size) {
+        while(lists[l].size() > size) {
+            where[lists[l].back()] = NONE;
+            lists[l].pop_back();
+        }
+    }
+
+    /* the least recently used block of `l` among `resident` */
+    bool lru_of(arc_list l, const std::vector<bid_t> &resident, bid_t &blk) {
+        for(auto iter = lists[l].rbegin(); iter != lists[l].rend(); iter++) {
+            if(std::find(resident.begin(), resident.end(), *iter) != resident.end()) {
+                blk = *iter;
+                return true;
+            }
+        }
+        return false;
+    }
+
+public:
+    arc_policy_t(bid_t nblocks, bid_t ncblock) : capacity(ncblock), target(0), missed(0), where(nblocks, NONE) { }
+
+    void hit(bid_t blk) { push(blk, T2); }
+
+    void miss(bid_t blk) {
+        missed = blk;
+        if(where[blk] == B1) {
+            target = std::min(capacity, target + std::max<size_t>(lists[B2].size() / std::max<size_t>(lists[B1].size(), 1), 1));
+        } else if(where[blk] == B2) {
+            size_t delta = std::max<size_t>(lists[B1].size() / std::max<size_t>(lists[B2].size(), 1), 1);
+            target = target > delta ? target - delta : 0;
+        }
+    }
+
+    bid_t victim(const std::vector<bid_t> &resident) {
+        bid_t blk = resident.front();
+        bool from_t1 = !lists[T1].empty() && (lists[T1].size() > target || (where[missed] == B2 && lists[T1].size() == target));
+        if(from_t1) {
+            if(!lru_of(T1, resident, blk)) lru_of(T2, resident, blk);
+        } else {
+            if(!lru_of(T2, resident, blk)) lru_of(T1, resident, blk);
+        }
+        return blk;
+    }
+
+    void evict(bid_t blk) {
+        if(where[blk] == T1) push(blk, B1);
+        else if(where[blk] == T2) push(blk, B2);
+        trim(B1, capacity);
+        trim(B2, capacity);
+    }
+
+    void insert(bid_t blk) {
+        /* a block seen recently in the ghost lists is frequent */
+        if(where[blk] == B1 || where[blk] == B2) push(blk, T2);
+        else push(blk, T1);
+    }
+};
+
+class belady_policy_t : public cache_policy {
+private:
+    std::vector<size_t> next_use;   /* the position of each block in the plan */
+    lru_policy_t lru;               /* break the ties of the blocks out of the plan */
+
+public:
+    belady_policy_t(bid_t nblocks) : next_use(nblocks, std::numeric_limits<size_t>::max()), lru(nblocks) { }
+
+    void plan(const std::vector<bid_t> &sequence) {
+        std::fill(next_use.begin(), next_use.end(), std::numeric_limits<size_t>::max());
+        for(size_t pos = sequence.size(); pos > 0; pos--) next_use[sequence[pos - 1]] = pos - 1;
+    }
+
+    void hit(bid_t blk) { lru.hit(blk); }
+
+    /* the block needed furthest in the plan, the least recently used one of the ties */
+    bid_t victim(const std::vector<bid_t> &resident) {
+        bid_t blk = resident.front();
+        for(bid_t cand : resident) {
+            size_t dist = next_use[cand], best = next_use[blk];
+            if(dist > best || (dist == best && lru.last_used(cand) < lru.last_used(blk))) blk = cand;
+        }
+        return blk;
+    }
+
+    void evict(bid_t blk) { }
+    void insert(bid_t blk) { lru.insert(blk); }
+};
+
+inline cache_policy *make_cache_policy(const std::string &name, bid_t nblocks, bid_t ncblock) {
+    if(name == "lfu") return new lfu_policy_t(nblocks);
+    if(name == "arc") return new arc_policy_t(nblocks, ncblock);
+    if(name == "belady") return new belady_policy_t(nblocks);
+    if(name != "lru") logstream(LOG_WARNING) << "unknown cache policy " << name << ", use lru" << std::endl;
+    return new lru_policy_t(nblocks);
+}
+
+#endif
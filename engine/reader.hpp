@@ -0,0 +1,153 @@
+#ifndef _GRAPH_READER_H_
+#define _GRAPH_READER_H_
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "api/types.hpp"
+#include "api/graph_buffer.hpp"
+#include "walk.hpp"
+
+/** graph_walk_reader
+ *
+ * This file contribute to define the double-buffered disk walk reader. A background thread reads the disk
+ * walks of the scheduled block pairs into a back buffer, while the engine updates the walks in the front
+ * buffer (`walk_manager->walks`). Each walk file is opened once and read sequentially, the read walks are dropped by
+ * `graph_walk::dump_walks` on the engine thread once the last batch of the pair has been updated, so the walks which
+ * the update spills into the same pair are kept.
+ *
+ * If `cross_pair` is false, the reader will not start a block pair before all the walks of the previous
+ * pairs have been updated, because the update may move walks into the files of the following pairs.
+ */
+
+class graph_walk_reader {
+private:
+    graph_walk *walk_manager;
+    std::vector<bid_t> exec_blocks;     /* the block pairs to read */
+    wid_t max_walks;                    /* the maximum number of walks in one batch */
+    bool cross_pair;
+
+    graph_buffer<walker_t> back;        /* the batch that has been read, but not updated */
+    bid_t back_block;                   /* the block pair of the back batch */
+    wid_t back_pair_walks;              /* the walks read from the pair of the back batch, set on its last batch */
+    off_t back_off;                     /* the offset after the walks read from the pair of the back batch */
+    bid_t front_block;                  /* the same of the batch being updated */
+    wid_t front_pair_walks;
+    off_t front_off;
+    bool back_full, back_last, finished;
+    size_t updated_pairs;               /* the number of block pairs which walks have been updated */
+
+    std::mutex mtx;
+    std::condition_variable cond;
+    std::thread worker;
+
+    void read_walks() {
+        for(size_t index = 0; index < exec_blocks.size(); index++) {
+            bid_t exec_block = exec_blocks[index];
+            if(!cross_pair) {
+                std::unique_lock<std::mutex> lock(mtx);
+                cond.wait(lock, [this, index] { return updated_pairs >= index; });
+            }
+
+            wid_t num_disk_walks = walk_manager->ndwalks(exec_block);
+            if(num_disk_walks == 0) {
+                std::lock_guard<std::mutex> lock(mtx);
+                updated_pairs++;
+                cond.notify_all();
+                continue;
+            }
+
+            block_desc_manager_t block_desc(walk_manager->walk_name(exec_block));
+            off_t disk_off = walk_manager->block_doff[exec_block];
+            wid_t pair_walks = num_disk_walks;
+            while(num_disk_walks > 0) {
+                {
+                    std::unique_lock<std::mutex> lock(mtx);
+                    cond.wait(lock, [this] { return !back_full; });
+                }
+                wid_t interval_walks = std::min(num_disk_walks, max_walks);
+                wid_t nwalks = walk_manager->load_disk_walks(exec_block, block_desc.get_desc(), interval_walks, disk_off, back);
+                assert(nwalks > 0);
+                num_disk_walks -= nwalks;
+
+                std::lock_guard<std::mutex> lock(mtx);
+                back_block = exec_block;
+                back_last = (num_disk_walks == 0);
+                back_pair_walks = pair_walks;
+                back_off = disk_off;
+                back_full = true;
+                cond.notify_all();
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mtx);
+        finished = true;
+        cond.notify_all();
+    }
+
+public:
+    graph_walk_reader(graph_walk *manager, wid_t max_nwalks) {
+        walk_manager = manager;
+        max_walks = max_nwalks;
+        back.alloc(max_nwalks);
+        cross_pair = true;
+        back_full = back_last = finished = false;
+        back_block = front_block = 0;
+        back_pair_walks = front_pair_walks = 0;
+        back_off = front_off = 0;
+        updated_pairs = 0;
+    }
+
+    ~graph_walk_reader() {
+        if(worker.joinable()) worker.join();
+        back.destroy();
+    }
+
+    /* read at most `max_nwalks` walks per batch from the next `start`, up to the capacity of the constructor */
+    void set_max_walks(wid_t max_nwalks) {
+        max_walks = max_nwalks;
+    }
+
+    /* start to read the disk walks of `blocks` in the background */
+    void start(const std::vector<bid_t> &blocks, bool read_cross_pair) {
+        if(worker.joinable()) worker.join();
+        exec_blocks = blocks;
+        cross_pair = read_cross_pair;
+        back_full = back_last = finished = false;
+        updated_pairs = 0;
+        worker = std::thread(&graph_walk_reader::read_walks, this);
+    }
+
+    /**
+     * wait for the next batch and swap it into `walks`, return false if all the pairs have been read.
+     * `exec_block` is the block pair of the batch, `last` indicates whether it is the last batch of the pair.
+     */
+    bool next(graph_buffer<walker_t> &walks, bid_t &exec_block, bool &last) {
+        std::unique_lock<std::mutex> lock(mtx);
+        cond.wait(lock, [this] { return back_full || finished; });
+        if(!back_full) return false;
+        walks.swap(back);
+        exec_block = front_block = back_block;
+        last = back_last;
+        front_pair_walks = back_pair_walks;
+        front_off = back_off;
+        back_full = false;
+        cond.notify_all();
+        return true;
+    }
+
+    /* the walks of the current batch have been updated, drop the read walks of the pair after its last batch */
+    void done(bool last) {
+        if(!last) return;
+        walk_manager->dump_walks(front_block, front_pair_walks, front_off);
+        std::lock_guard<std::mutex> lock(mtx);
+        updated_pairs++;
+        cond.notify_all();
+    }
+
+    void finish() {
+        if(worker.joinable()) worker.join();
+    }
+};
+
+#endif
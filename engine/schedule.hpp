@@ -11,6 +11,7 @@
 #include <cstdlib>
 #include <ctime>
 #include <cmath>
+#include <iostream>
 
 #include "cache.hpp"
 #include "config.hpp"
@@ -44,6 +45,129 @@ public:
         return 0;
     }
 
+    /* load the blocks of `loads`, the (cache index, block index) pairs, a block with few pending walks is loaded selectively */
+    void load_blocks(graph_cache &cache, graph_driver &driver, graph_walk &walk_manager, const std::vector<std::pair<bid_t, bid_t>> &loads) {
+        std::vector<std::pair<bid_t, bid_t>> full_loads;
+        std::vector<vid_t> verts;
+        for(const auto &load : loads) {
+            const block_t &block = (*(walk_manager.global_blocks))[load.second];
+            if(cache.selective_load(block, walk_manager.block_active_walks(load.second))) {
+                walk_manager.block_vertices(load.second, verts);
+                driver.load_block_sparse(cache, walk_manager.global_blocks, load.first, load.second, verts);
+            } else {
+                full_loads.push_back(load);
+            }
+        }
+        driver.load_blocks(cache, walk_manager.global_blocks, full_loads);
+    }
+
+    /**
+     * make the blocks of this round resident and queue their block pairs with walks, only the blocks at an end of
+     * such a pair are needed. the missed blocks are loaded into the slots chosen by the cache replacement policy,
+     * which may evict any block out of this round.
+     */
+    void swapin_blocks(graph_cache &cache, graph_driver &driver, graph_walk &walk_manager, const std::vector<bid_t> &candidate_blocks, const std::vector<wid_t> &block_walks) {
+        bid_t nblocks = walk_manager.nblocks;
+        std::vector<bool> needed(nblocks, false);
+        std::cout << "bucket sequence : ";
+        for(auto p_blk : candidate_blocks) {
+            for(auto c_blk : candidate_blocks) {
+                if(block_walks[p_blk * nblocks + c_blk] > 0) {
+                    std::cout << p_blk << " -> " << c_blk << ", ";
+                    cache.walk_blocks.push_back(p_blk * nblocks + c_blk);
+                    needed[p_blk] = needed[c_blk] = true;
+                }
+            }
+        }
+        std::cout << std::endl;
+
+        /* no pair of the candidates has walks, run the pair with the most walks so that the walks keep moving */
+        if(cache.walk_blocks.empty()) {
+            bid_t blk = std::max_element(block_walks.begin(), block_walks.end()) - block_walks.begin();
+            if(block_walks[blk] > 0) {
+                logstream(LOG_DEBUG) << "no walks between the chosen blocks, run " << blk / nblocks << " -> " << blk % nblocks << std::endl;
+                cache.walk_blocks.push_back(blk);
+                needed[blk / nblocks] = needed[blk % nblocks] = true;
+            }
+        }
+
+        /* the plan for the replacement policy: the needed blocks, then the others by their pending walks */
+        std::vector<wid_t> partition_walks(nblocks, 0);
+        for(bid_t blk = 0; blk < nblocks * nblocks; blk++) {
+            partition_walks[blk / nblocks] += block_walks[blk];
+            if(blk / nblocks != blk % nblocks) partition_walks[blk % nblocks] += block_walks[blk];
+        }
+        std::vector<bid_t> sequence(nblocks);
+        std::iota(sequence.begin(), sequence.end(), 0);
+        std::stable_sort(sequence.begin(), sequence.end(), [&needed, &partition_walks](bid_t u, bid_t v) {
+            if(needed[u] != needed[v]) return (bool)needed[u];
+            return partition_walks[u] > partition_walks[v];
+        });
+        cache.plan(sequence);
+
+        std::vector<std::pair<bid_t, bid_t>> loads;
+        for(bid_t blk = 0; blk < nblocks; blk++) {
+            if(needed[blk] && (*(walk_manager.global_blocks))[blk].cache_index != nblocks) cache.hit(blk);
+        }
+        for(bid_t blk = 0; blk < nblocks; blk++) {
+            if(needed[blk] && (*(walk_manager.global_blocks))[blk].cache_index == nblocks) {
+                bid_t cache_index = cache.miss(blk, needed);
+                std::cout << "load block info, blk = " << blk << " -> cache_index = " << cache_index << std::endl;
+                loads.push_back(std::make_pair(cache_index, blk));
+            }
+        }
+        load_blocks(cache, driver, walk_manager, loads);
+    }
+
+    /**
+     * the schedule of the tail of a run, when a few walks are left: the block pairs are ranked by their walks
+     * weighted by the inverse of their steps left and divided by the blocks to load, so the walks closest to their
+     * end are finished first at the least I/O, and the blocks of the best pairs are taken up to the cache size.
+     * the other pairs with walks run in the same round, in the rank order, their walks read the adjacency lists of
+     * the uncached blocks directly (see `graph_tail_reader`).
+     */
+    void tail_schedule(graph_cache &cache, graph_driver &driver, graph_walk &walk_manager) {
+        bid_t nblocks = walk_manager.nblocks;
+        const std::vector<wid_t> &block_walks = walk_manager.block_pair_walks();
+        auto loads = [&walk_manager, nblocks](bid_t blk) {
+            return (bid_t)((*(walk_manager.global_blocks))[blk].cache_index == nblocks);
+        };
+        std::vector<std::pair<real_t, bid_t>> ranks;
+        for(bid_t blk = 0; blk < nblocks * nblocks; blk++) {
+            if(block_walks[blk] == 0) continue;
+            bid_t p_blk = blk / nblocks, c_blk = blk % nblocks;
+            bid_t nloads = loads(p_blk) + (p_blk != c_blk ? loads(c_blk) : 0);
+            ranks.push_back(std::make_pair(walk_manager.finish_score(blk) / (1 + nloads), blk));
+        }
+        std::stable_sort(ranks.begin(), ranks.end(), [](const std::pair<real_t, bid_t> &u, const std::pair<real_t, bid_t> &v) { return u.first > v.first; });
+
+        std::vector<bool> chosen(nblocks, false);
+        std::vector<bid_t> candidate_blocks;
+        for(const auto &rank : ranks) {
+            bid_t p_blk = rank.second / nblocks, c_blk = rank.second % nblocks;
+            size_t need = !chosen[p_blk] + (p_blk != c_blk && !chosen[c_blk]);
+            if(candidate_blocks.size() + need > cache.ncblock) continue;
+            if(!chosen[p_blk]) candidate_blocks.push_back(p_blk);
+            if(!chosen[c_blk] && p_blk != c_blk) candidate_blocks.push_back(c_blk);
+            chosen[p_blk] = chosen[c_blk] = true;
+        }
+        swapin_blocks(cache, driver, walk_manager, candidate_blocks, block_walks);
+        if(!cache.direct.ready()) return;
+        std::vector<bool> queued(nblocks * nblocks, false);
+        for(bid_t blk : cache.walk_blocks) queued[blk] = true;
+        for(const auto &rank : ranks) {
+            if(!queued[rank.second]) cache.walk_blocks.push_back(rank.second);
+        }
+    }
+
+    /**
+     * the scheduler state which is carried across rounds, saved and restored by the checkpoint. only the naive
+     * scheduler carries a state, the others choose the blocks of each round from the walk counts and the cache
+     * alone, so they save nothing and schedule the resumed run from the restored counts.
+     */
+    virtual void dump_state(std::ostream &os) { }
+    virtual void load_state(std::istream &is) { }
+
     ~scheduler() {}
 };
 
@@ -76,39 +200,23 @@ private:
         return target_block;
     }
 
-    bid_t swap_block(graph_cache &cache, graph_walk &walk_manager, bid_t exclude_block)
-    {
-        bid_t blk = 0;
-        int life = -1;
-        for (bid_t p = 0; p < cache.ncblock; ++p)
-        {
-            if (cache.cache_blocks[p].block == NULL)
-            {
-                blk = p;
-                break;
-            }
-            if (cache.cache_blocks[p].life > life && cache.cache_blocks[p].block->blk != exclude_block)
-            {
-                blk = p;
-                life = cache.cache_blocks[p].life;
-            }
-        }
-        if (cache.cache_blocks[blk].block != NULL)
-        {
-            cache.cache_blocks[blk].block->cache_index = walk_manager.global_blocks->nblocks;
-        }
-        return blk;
-    }
-
+    /* make `select_block` resident, the block `exclude_blk` is kept in the cache */
     void swapin_block(graph_cache &cache, graph_driver &driver, graph_walk &walk_manager, bid_t select_block, bid_t exclude_blk)
     {
-        bid_t cache_index = (*(walk_manager.global_blocks))[select_block].cache_index;
-        if (cache_index == walk_manager.global_blocks->nblocks)
+        bid_t nblocks = walk_manager.global_blocks->nblocks;
+        std::vector<bid_t> sequence(1, exec_blk);
+        if (index < buckets.size()) sequence.insert(sequence.end(), buckets.begin() + index, buckets.end());
+        cache.plan(sequence);
+
+        if ((*(walk_manager.global_blocks))[select_block].cache_index != nblocks)
         {
-            cache_index = swap_block(cache, walk_manager, exclude_blk);
-            driver.load_block_info(cache, walk_manager.global_blocks, cache_index, select_block);
+            cache.hit(select_block);
+            return;
         }
-        cache.cache_blocks[cache_index].life = 0;
+        std::vector<bool> pinned(nblocks, false);
+        if (exclude_blk != nblocks) pinned[exclude_blk] = true;
+        bid_t cache_index = cache.miss(select_block, pinned);
+        load_blocks(cache, driver, walk_manager, {std::make_pair(cache_index, select_block)});
     }
 
 public:
@@ -116,15 +224,31 @@ public:
         index = 0;
     }
 
+    void dump_state(std::ostream &os)
+    {
+        size_t nbuckets = buckets.size();
+        os.write((char *)&exec_blk, sizeof(bid_t));
+        os.write((char *)&index, sizeof(size_t));
+        os.write((char *)&nbuckets, sizeof(size_t));
+        os.write((char *)buckets.data(), nbuckets * sizeof(bid_t));
+    }
+
+    void load_state(std::istream &is)
+    {
+        size_t nbuckets = 0;
+        is.read((char *)&exec_blk, sizeof(bid_t));
+        is.read((char *)&index, sizeof(size_t));
+        is.read((char *)&nbuckets, sizeof(size_t));
+        buckets.resize(nbuckets);
+        is.read((char *)buckets.data(), nbuckets * sizeof(bid_t));
+    }
+
     bid_t schedule(graph_cache &cache, graph_driver &driver, graph_walk &walk_manager)
     {
         bid_t nblocks = walk_manager.global_blocks->nblocks;
         while(index >= buckets.size()) {
             buckets.clear();
             exec_blk = choose_block(walk_manager);
-            swapin_block(cache, driver, walk_manager, exec_blk, nblocks);
-            for (bid_t p = 0; p < cache.ncblock; ++p)
-                cache.cache_blocks[p].life++;
             for (bid_t blk = 0; blk < walk_manager.global_blocks->nblocks; blk++)
             {
                 if (walk_manager.nblockwalks(blk * nblocks + exec_blk) > 0 || walk_manager.nblockwalks(exec_blk * nblocks + blk) > 0)
@@ -133,6 +257,7 @@ public:
                 }
             }
             index = 0;
+            swapin_block(cache, driver, walk_manager, exec_blk, nblocks);
         }
 
         bid_t blk = buckets[index];
@@ -150,7 +275,8 @@ public:
 };
 
 /**
- * 
+ * The simulated annealing scheduler, each round searches the blocks to cache from the block pair walks, nothing is
+ * carried to the next round (`buckets` is only the choice of the current round), so it has no checkpoint state.
  */
 class simulated_annealing_scheduler_t : public scheduler
 {
@@ -167,10 +293,7 @@ private:
         }
 
         bid_t nblocks = walk_manager.nblocks;
-        std::vector<wid_t> block_walks(nblocks * nblocks);
-        for(bid_t blk = 0; blk < nblocks * nblocks; blk++) {
-            block_walks[blk] = walk_manager.nblockwalks(blk);
-        }
+        const std::vector<wid_t> &block_walks = walk_manager.block_pair_walks();
 
         std::vector<wid_t> partition_walks(nblocks, 0);
         for(bid_t c_blk = 0; c_blk < nblocks; c_blk++) {
@@ -241,7 +364,8 @@ private:
             size_t iter = 0;
             size_t can_comm = 0;
             for(auto blk : candidate_blocks) if(cache_blocks.find(blk) != cache_blocks.end()) can_comm++;
-            real_t y_can = cal_score(candidate_blocks) / (cache.ncblock - can_comm);
+            /* all the candidates may be cached already, e.g. after a preload */
+            real_t y_can = cal_score(candidate_blocks) / std::max<size_t>(cache.ncblock - can_comm, 1);
 
             std::srand(std::time(nullptr));
             while(iter < max_iter) {
@@ -278,47 +402,7 @@ private:
         }
 
         buckets = candidate_blocks;
-        std::unordered_set<bid_t> bucket_uncached, bucket_cached;
-
-        for(bid_t blk = 0; blk < buckets.size(); blk++) {
-            if(cache_blocks.find(buckets[blk]) != cache_blocks.end()) {
-                bucket_cached.insert(buckets[blk]);
-            }else{
-                bucket_uncached.insert(buckets[blk]);
-            }
-        }
-
-        size_t pos = 0;
-        for(auto blk : bucket_cached) {
-            bid_t cache_index = (*(walk_manager.global_blocks))[blk].cache_index;
-            swap(cache.cache_blocks[pos], cache.cache_blocks[cache_index]);
-            cache.cache_blocks[pos].block->cache_index = pos;
-            cache.cache_blocks[cache_index].block->cache_index = cache_index;
-            std::cout << "swap block info, blk = " << blk << ", from " << cache_index << " to " << pos << std::endl;
-            pos++;
-        }
-
-        for(auto blk : bucket_uncached) {
-            if(partition_walks[blk] > 0) {
-                if(cache.cache_blocks[pos].block != NULL) {
-                    cache.cache_blocks[pos].block->cache_index = nblocks;
-                }
-                std::cout << "load block info, blk = " << blk << " to " << pos << std::endl;
-                driver.load_block_info(cache, walk_manager.global_blocks, pos, blk);
-                pos++;
-            }
-        }
-
-        std::cout << "bucket sequence : ";
-        for(auto p_blk : buckets) {
-            for(auto c_blk : buckets) {
-                if(block_walks[p_blk * nblocks + c_blk] > 0) {
-                    std::cout << p_blk << " -> " << c_blk << ", ";
-                    cache.walk_blocks.push_back(p_blk * nblocks + c_blk);
-                }
-            }
-        }
-        std::cout << std::endl;
+        swapin_blocks(cache, driver, walk_manager, buckets, block_walks);
     }
 
 public:
@@ -359,11 +443,7 @@ private:
         }
 
         bid_t nblocks = walk_manager.nblocks;
-        std::vector<wid_t> block_walks(nblocks * nblocks);
-        for (bid_t blk = 0; blk < nblocks * nblocks; blk++)
-        {
-            block_walks[blk] = walk_manager.nblockwalks(blk);
-        }
+        const std::vector<wid_t> &block_walks = walk_manager.block_pair_walks();
 
         std::vector<wid_t> partition_walks(nblocks, 0);
         for (bid_t p_blk = 0; p_blk < nblocks; p_blk++)
@@ -496,58 +576,7 @@ private:
         }
 
         buckets = candidate_blocks;
-        std::unordered_set<bid_t> bucket_uncached, bucket_cached;
-
-        for (bid_t blk = 0; blk < buckets.size(); blk++)
-        {
-            if (cache_blocks.find(buckets[blk]) != cache_blocks.end())
-            {
-                bucket_cached.insert(buckets[blk]);
-            }
-            else
-            {
-                bucket_uncached.insert(buckets[blk]);
-            }
-        }
-
-        size_t pos = 0;
-        for (auto blk : bucket_cached)
-        {
-            bid_t cache_index = (*(walk_manager.global_blocks))[blk].cache_index;
-            swap(cache.cache_blocks[pos], cache.cache_blocks[cache_index]);
-            cache.cache_blocks[pos].block->cache_index = pos;
-            cache.cache_blocks[cache_index].block->cache_index = cache_index;
-            std::cout << "swap block info, blk = " << blk << ", from " << cache_index << " to " << pos << std::endl;
-            pos++;
-        }
-
-        for (auto blk : bucket_uncached)
-        {
-            if (partition_walks[blk] > 0)
-            {
-                if (cache.cache_blocks[pos].block != NULL)
-                {
-                    cache.cache_blocks[pos].block->cache_index = nblocks;
-                }
-                std::cout << "load block info, blk = " << blk << " -> cache_index = " << pos << std::endl;
-                driver.load_block_info(cache, walk_manager.global_blocks, pos, blk);
-                pos++;
-            }
-        }
-
-        std::cout << "bucket sequence : ";
-        for (auto p_blk : buckets)
-        {
-            for (auto c_blk : buckets)
-            {
-                if (block_walks[p_blk * nblocks + c_blk] > 0)
-                {
-                    std::cout << p_blk << " -> " << c_blk << ", ";
-                    cache.walk_blocks.push_back(p_blk * nblocks + c_blk);
-                }
-            }
-        }
-        std::cout << std::endl;
+        swapin_blocks(cache, driver, walk_manager, buckets, block_walks);
     }
 
 public:
@@ -570,21 +599,8 @@ class random_scheduler_t : public scheduler
 private:
     void choose_blocks(graph_cache &cache, graph_driver &driver, graph_walk &walk_manager)
     {
-        std::unordered_set<bid_t> cache_blocks;
-        for (bid_t blk = 0; blk < cache.ncblock; blk++)
-        {
-            if (cache.cache_blocks[blk].block != NULL)
-            {
-                cache_blocks.insert(cache.cache_blocks[blk].block->blk);
-            }
-        }
-
         bid_t nblocks = walk_manager.nblocks;
-        std::vector<wid_t> block_walks(nblocks * nblocks);
-        for (bid_t blk = 0; blk < nblocks * nblocks; blk++)
-        {
-            block_walks[blk] = walk_manager.nblockwalks(blk);
-        }
+        const std::vector<wid_t> &block_walks = walk_manager.block_pair_walks();
 
         std::vector<wid_t> partition_walks(nblocks, 0);
         for (bid_t p_blk = 0; p_blk < nblocks; p_blk++)
@@ -609,55 +625,7 @@ private:
             candidate_blocks.push_back(remaining_blocks[blk_index]);
         }
 
-        std::unordered_set<bid_t> bucket_uncached, bucket_cached;
-        for (bid_t blk = 0; blk < candidate_blocks.size(); blk++)
-        {
-            if(cache_blocks.find(candidate_blocks[blk]) != cache_blocks.end()) {
-                bucket_cached.insert(candidate_blocks[blk]);
-            }
-            else {
-                bucket_uncached.insert(candidate_blocks[blk]);
-            }
-        }
-
-        size_t pos = 0;
-        for (auto blk : bucket_cached)
-        {
-            bid_t cache_index = (*(walk_manager.global_blocks))[blk].cache_index;
-            swap(cache.cache_blocks[pos], cache.cache_blocks[cache_index]);
-            cache.cache_blocks[pos].block->cache_index = pos;
-            cache.cache_blocks[cache_index].block->cache_index = cache_index;
-            std::cout << "swap block info, blk = " << blk << ", from " << cache_index << " to " << pos << std::endl;
-            pos++;
-        }
-
-        for (auto blk : bucket_uncached)
-        {
-            if (partition_walks[blk] > 0)
-            {
-                if (cache.cache_blocks[pos].block != NULL)
-                {
-                    cache.cache_blocks[pos].block->cache_index = nblocks;
-                }
-                std::cout << "load block info, blk = " << blk << " -> cache_index = " << pos << std::endl;
-                driver.load_block_info(cache, walk_manager.global_blocks, pos, blk);
-                pos++;
-            }
-        }
-
-        std::cout << "bucket sequence : " << candidate_blocks.size() << " ";
-        for (auto p_blk : candidate_blocks)
-        {
-            for (auto c_blk : candidate_blocks)
-            {
-                if (block_walks[p_blk * nblocks + c_blk] > 0)
-                {
-                    std::cout << p_blk << " -> " << c_blk << ", ";
-                    cache.walk_blocks.push_back(p_blk * nblocks + c_blk);
-                }
-            }
-        }
-        std::cout << std::endl;
+        swapin_blocks(cache, driver, walk_manager, candidate_blocks, block_walks);
         if(cache.walk_blocks.empty()) {
             logstream(LOG_ERROR) << "random scheduler choose blocks without walks to update." << std::endl;
             exit(0);
@@ -686,21 +654,8 @@ class greedy_scheduler_t : public scheduler
 private:
     void choose_blocks(graph_cache &cache, graph_driver &driver, graph_walk &walk_manager)
     {
-        std::unordered_set<bid_t> cache_blocks;
-        for (bid_t blk = 0; blk < cache.ncblock; blk++)
-        {
-            if (cache.cache_blocks[blk].block != NULL)
-            {
-                cache_blocks.insert(cache.cache_blocks[blk].block->blk);
-            }
-        }
-
         bid_t nblocks = walk_manager.nblocks;
-        std::vector<wid_t> block_walks(nblocks * nblocks);
-        for (bid_t blk = 0; blk < nblocks * nblocks; blk++)
-        {
-            block_walks[blk] = walk_manager.nblockwalks(blk);
-        }
+        const std::vector<wid_t> &block_walks = walk_manager.block_pair_walks();
 
         std::vector<wid_t> from_p_walks(nblocks, 0), to_p_walks(nblocks, 0);
         for (bid_t p_blk = 0; p_blk < nblocks; p_blk++)
@@ -731,57 +686,7 @@ private:
             candidate_blocks.push_back(remaining_blocks[blk_index]);
         }
 
-        std::unordered_set<bid_t> bucket_uncached, bucket_cached;
-        for (bid_t blk = 0; blk < candidate_blocks.size(); blk++)
-        {
-            if (cache_blocks.find(candidate_blocks[blk]) != cache_blocks.end())
-            {
-                bucket_cached.insert(candidate_blocks[blk]);
-            }
-            else
-            {
-                bucket_uncached.insert(candidate_blocks[blk]);
-            }
-        }
-
-        size_t pos = 0;
-        for (auto blk : bucket_cached)
-        {
-            bid_t cache_index = (*(walk_manager.global_blocks))[blk].cache_index;
-            swap(cache.cache_blocks[pos], cache.cache_blocks[cache_index]);
-            cache.cache_blocks[pos].block->cache_index = pos;
-            cache.cache_blocks[cache_index].block->cache_index = cache_index;
-            std::cout << "swap block info, blk = " << blk << ", from " << cache_index << " to " << pos << std::endl;
-            pos++;
-        }
-
-        for (auto blk : bucket_uncached)
-        {
-            if (from_p_walks[blk] > 0 || to_p_walks[blk] > 0)
-            {
-                if (cache.cache_blocks[pos].block != NULL)
-                {
-                    cache.cache_blocks[pos].block->cache_index = nblocks;
-                }
-                std::cout << "load block info, blk = " << blk << " -> cache_index = " << pos << std::endl;
-                driver.load_block_info(cache, walk_manager.global_blocks, pos, blk);
-                pos++;
-            }
-        }
-
-        std::cout << "bucket sequence : " << candidate_blocks.size() << " ";
-        for (auto p_blk : candidate_blocks)
-        {
-            for (auto c_blk : candidate_blocks)
-            {
-                if (block_walks[p_blk * nblocks + c_blk] > 0)
-                {
-                    std::cout << p_blk << " -> " << c_blk << ", ";
-                    cache.walk_blocks.push_back(p_blk * nblocks + c_blk);
-                }
-            }
-        }
-        std::cout << std::endl;
+        swapin_blocks(cache, driver, walk_manager, candidate_blocks, block_walks);
         if (cache.walk_blocks.empty())
         {
             logstream(LOG_ERROR) << "random scheduler choose blocks without walks to update." << std::endl;
@@ -810,21 +715,8 @@ class greedy_graphwalker_scheduler_t : public scheduler
 private:
     void choose_blocks(graph_cache &cache, graph_driver &driver, graph_walk &walk_manager)
     {
-        std::unordered_set<bid_t> cache_blocks;
-        for (bid_t blk = 0; blk < cache.ncblock; blk++)
-        {
-            if (cache.cache_blocks[blk].block != NULL)
-            {
-                cache_blocks.insert(cache.cache_blocks[blk].block->blk);
-            }
-        }
-
         bid_t nblocks = walk_manager.nblocks;
-        std::vector<wid_t> block_walks(nblocks * nblocks);
-        for (bid_t blk = 0; blk < nblocks * nblocks; blk++)
-        {
-            block_walks[blk] = walk_manager.nblockwalks(blk);
-        }
+        const std::vector<wid_t> &block_walks = walk_manager.block_pair_walks();
 
         std::vector<wid_t> from_p_walks(nblocks, 0), to_p_walks(nblocks, 0);
         for (bid_t p_blk = 0; p_blk < nblocks; p_blk++)
@@ -856,57 +748,7 @@ private:
             candidate_blocks.push_back(remaining_blocks[blk_index]);
         }
 
-        std::unordered_set<bid_t> bucket_uncached, bucket_cached;
-        for (bid_t blk = 0; blk < candidate_blocks.size(); blk++)
-        {
-            if (cache_blocks.find(candidate_blocks[blk]) != cache_blocks.end())
-            {
-                bucket_cached.insert(candidate_blocks[blk]);
-            }
-            else
-            {
-                bucket_uncached.insert(candidate_blocks[blk]);
-            }
-        }
-
-        size_t pos = 0;
-        for (auto blk : bucket_cached)
-        {
-            bid_t cache_index = (*(walk_manager.global_blocks))[blk].cache_index;
-            swap(cache.cache_blocks[pos], cache.cache_blocks[cache_index]);
-            cache.cache_blocks[pos].block->cache_index = pos;
-            cache.cache_blocks[cache_index].block->cache_index = cache_index;
-            std::cout << "swap block info, blk = " << blk << ", from " << cache_index << " to " << pos << std::endl;
-            pos++;
-        }
-
-        for (auto blk : bucket_uncached)
-        {
-            if (from_p_walks[blk] > 0 || to_p_walks[blk] > 0)
-            {
-                if (cache.cache_blocks[pos].block != NULL)
-                {
-                    cache.cache_blocks[pos].block->cache_index = nblocks;
-                }
-                std::cout << "load block info, blk = " << blk << " -> cache_index = " << pos << std::endl;
-                driver.load_block_info(cache, walk_manager.global_blocks, pos, blk);
-                pos++;
-            }
-        }
-
-        std::cout << "bucket sequence : " << candidate_blocks.size() << " ";
-        for (auto p_blk : candidate_blocks)
-        {
-            for (auto c_blk : candidate_blocks)
-            {
-                if (block_walks[p_blk * nblocks + c_blk] > 0)
-                {
-                    std::cout << p_blk << " -> " << c_blk << ", ";
-                    cache.walk_blocks.push_back(p_blk * nblocks + c_blk);
-                }
-            }
-        }
-        std::cout << std::endl;
+        swapin_blocks(cache, driver, walk_manager, candidate_blocks, block_walks);
         if (cache.walk_blocks.empty())
         {
             logstream(LOG_ERROR) << "random scheduler choose blocks without walks to update." << std::endl;
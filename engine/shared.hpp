@@ -0,0 +1,260 @@
+#ifndef _GRAPH_SHARED_H_
+#define _GRAPH_SHARED_H_
+
+#include <new>
+#include <atomic>
+#include <string>
+#include <functional>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "api/types.hpp"
+#include "util/timer.hpp"
+#include "logger/logger.hpp"
+
+/** graph_shared_cache
+ *
+ * This file contribute to define the block cache shared by the concurrent jobs on the same dataset, e.g. the
+ * processes of a parameter sweep. The loaded blocks live in a POSIX shared memory segment, the first process
+ * creates and initializes the segment and the others attach to it, each block has a reference count of the
+ * jobs using it, so a job attaches to a block another job has already loaded instead of reading it again, and
+ * only the blocks no job references are evicted (least recently used first).
+ *
+ * shared memory layout : shared_header_t | shared_block_t of each block | slot owners | the slots (page aligned)
+ *
+ * A slot has the same layout as a slot of the block arena. The segment is keyed by the dataset, the block size and
+ * the slot layout, the last job detaching from it removes it. A job that dies holding references leaks them until
+ * the segment is removed, the other jobs fall back to their private memory when no slot is free.
+ */
+
+#define SHARED_MAGIC 0x31304548534f5753ULL  /* "SWOSHE01" */
+#define SHARED_PAGE  4096
+#define SHARED_WAIT_SECONDS 60.0            /* give up waiting for the load of another job after this long */
+
+enum shared_state { SHARED_EMPTY = 0, SHARED_LOADING, SHARED_READY };
+
+struct shared_header_t {
+    std::atomic<uint64_t> magic;    /* set after the segment is initialized */
+    uint64_t nblocks, nslots, slot_bytes, layout;
+    uint64_t clock;                 /* the logical time of the block uses */
+    uint32_t nprocs;                /* the attached jobs */
+    pthread_mutex_t mtx;            /* process shared, protects everything below the header */
+};
+
+struct shared_block_t {
+    uint32_t state;
+    uint32_t slot;
+    uint32_t refs;                  /* the jobs referencing the block */
+    uint32_t loader;                /* the process id of the job loading the block */
+    uint64_t last_use;
+};
+
+inline size_t shared_meta_bytes(uint64_t nblocks, uint64_t nslots) {
+    size_t bytes = sizeof(shared_header_t) + nblocks * sizeof(shared_block_t) + nslots * sizeof(uint32_t);
+    return (bytes + SHARED_PAGE - 1) / SHARED_PAGE * SHARED_PAGE;
+}
+
+class graph_shared_cache {
+private:
+    std::string name;
+    void *segment;
+    size_t segment_bytes;
+    shared_header_t *header;
+    shared_block_t *entries;
+    uint32_t *owners;               /* the block of each slot, `nblocks` if the slot is free */
+    char *slots;
+
+    void lock() {
+        if(pthread_mutex_lock(&header->mtx) == EOWNERDEAD) pthread_mutex_consistent(&header->mtx);
+    }
+
+    void unlock() { pthread_mutex_unlock(&header->mtx); }
+
+    bool create(bid_t nblocks, size_t slot_bytes, size_t capacity, uint64_t layout) {
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+        if(fd < 0) return false;
+        uint64_t nslots = capacity / slot_bytes;
+        segment_bytes = shared_meta_bytes(nblocks, nslots) + nslots * slot_bytes;
+        if(nslots == 0 || ftruncate(fd, segment_bytes) != 0 || (segment = mmap(NULL, segment_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+            ::close(fd);
+            shm_unlink(name.c_str());
+            segment = NULL;
+            logstream(LOG_WARNING) << "can not create the shared cache " << name << " of " << capacity << " bytes" << std::endl;
+            return true;
+        }
+        ::close(fd);
+
+        header = new (segment) shared_header_t;
+        header->nblocks = nblocks;
+        header->nslots = nslots;
+        header->slot_bytes = slot_bytes;
+        header->layout = layout;
+        header->clock = 0;
+        header->nprocs = 1;
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&header->mtx, &attr);
+        pthread_mutexattr_destroy(&attr);
+        map_regions();
+        for(bid_t blk = 0; blk < nblocks; blk++) entries[blk] = shared_block_t{SHARED_EMPTY, 0, 0, 0, 0};
+        for(uint64_t s = 0; s < nslots; s++) owners[s] = nblocks;
+        header->magic.store(SHARED_MAGIC, std::memory_order_release);
+        logstream(LOG_INFO) << "create the shared cache " << name << " : " << nslots << " slots, " << segment_bytes << " bytes" << std::endl;
+        return true;
+    }
+
+    void attach(bid_t nblocks, size_t slot_bytes, uint64_t layout) {
+        int fd = -1;
+        struct stat st;
+        graph_timer t;
+        t.start_time();
+        /* the creator may not have sized the segment yet */
+        while(true) {
+            fd = shm_open(name.c_str(), O_RDWR, S_IRUSR | S_IWUSR);
+            if(fd >= 0 && fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(shared_header_t)) break;
+            if(fd >= 0) ::close(fd);
+            if(t.runtime() > SHARED_WAIT_SECONDS) return;
+            usleep(1000);
+        }
+        segment_bytes = st.st_size;
+        segment = mmap(NULL, segment_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if(segment == MAP_FAILED) {
+            segment = NULL;
+            return;
+        }
+        header = static_cast<shared_header_t *>(segment);
+        while(header->magic.load(std::memory_order_acquire) != SHARED_MAGIC && t.runtime() < SHARED_WAIT_SECONDS) usleep(1000);
+        if(header->magic.load(std::memory_order_acquire) != SHARED_MAGIC || header->nblocks != nblocks || header->slot_bytes != slot_bytes || header->layout != layout) {
+            logstream(LOG_WARNING) << "the shared cache " << name << " belongs to another layout, use the private cache" << std::endl;
+            munmap(segment, segment_bytes);
+            segment = NULL;
+            return;
+        }
+        map_regions();
+        lock();
+        header->nprocs++;
+        unlock();
+        logstream(LOG_INFO) << "attach to the shared cache " << name << " : " << header->nslots << " slots, " << header->nprocs << " jobs" << std::endl;
+    }
+
+    void map_regions() {
+        entries = reinterpret_cast<shared_block_t *>(static_cast<char *>(segment) + sizeof(shared_header_t));
+        owners = reinterpret_cast<uint32_t *>(entries + header->nblocks);
+        slots = static_cast<char *>(segment) + shared_meta_bytes(header->nblocks, header->nslots);
+    }
+
+    /* a free slot, or the slot of the least recently used block no job references, `nslots` if none */
+    uint64_t find_slot() {
+        uint64_t victim = header->nslots;
+        for(uint64_t s = 0; s < header->nslots; s++) {
+            if(owners[s] == header->nblocks) return s;
+            const shared_block_t &entry = entries[owners[s]];
+            if(entry.state == SHARED_READY && entry.refs == 0 && (victim == header->nslots || entry.last_use < entries[owners[victim]].last_use)) victim = s;
+        }
+        if(victim != header->nslots) {
+            entries[owners[victim]].state = SHARED_EMPTY;
+            owners[victim] = header->nblocks;
+        }
+        return victim;
+    }
+
+public:
+    size_t nattaches, nloads, nfallbacks;   /* the blocks found in the segment, loaded into it, and loaded privately */
+
+    graph_shared_cache() : segment(NULL), segment_bytes(0), header(NULL), entries(NULL), owners(NULL), slots(NULL), nattaches(0), nloads(0), nfallbacks(0) { }
+
+    ~graph_shared_cache() { detach(); }
+
+    bool attached() const { return segment != NULL; }
+    size_t nslots() const { return attached() ? header->nslots : 0; }
+
+    /**
+     * create the segment of `capacity` bytes, or attach to the segment created by another job. `key` names the
+     * dataset and block size, `layout` tells the slot layout apart, e.g. raw or bit packed blocks.
+     */
+    void open(const std::string &key, bid_t nblocks, size_t slot_bytes, size_t capacity, uint64_t layout) {
+        name = "/sowalker_" + std::to_string(std::hash<std::string>()(key + "#" + std::to_string(slot_bytes) + "#" + std::to_string(layout)));
+        if(!create(nblocks, slot_bytes, capacity, layout)) attach(nblocks, slot_bytes, layout);
+    }
+
+    void detach() {
+        if(!attached()) return;
+        lock();
+        bool last = --header->nprocs == 0;
+        unlock();
+        munmap(segment, segment_bytes);
+        segment = NULL;
+        if(last) shm_unlink(name.c_str());
+    }
+
+    /**
+     * reference the block `blk`, return its slot, `fill` tells whether the caller must load the block into the
+     * slot and then call `ready`. return NULL if no slot is free, the caller loads the block privately.
+     */
+    char *acquire(bid_t blk, bool &fill) {
+        graph_timer t;
+        t.start_time();
+        fill = false;
+        lock();
+        /* another job is loading the block, wait for it, unless that job has died */
+        while(entries[blk].state == SHARED_LOADING && t.runtime() < SHARED_WAIT_SECONDS) {
+            if(kill(entries[blk].loader, 0) != 0 && errno == ESRCH) {
+                owners[entries[blk].slot] = header->nblocks;
+                entries[blk].state = SHARED_EMPTY;
+                entries[blk].refs = 0;
+                break;
+            }
+            unlock();
+            usleep(100);
+            lock();
+        }
+        shared_block_t &entry = entries[blk];
+        char *slot = NULL;
+        if(entry.state == SHARED_READY) {
+            slot = slots + entry.slot * header->slot_bytes;
+            nattaches++;
+        } else if(entry.state == SHARED_EMPTY) {
+            uint64_t s = find_slot();
+            if(s != header->nslots) {
+                owners[s] = blk;
+                entry.slot = s;
+                entry.state = SHARED_LOADING;
+                entry.loader = getpid();
+                slot = slots + s * header->slot_bytes;
+                fill = true;
+                nloads++;
+            }
+        }
+        if(slot) {
+            entry.refs++;
+            entry.last_use = ++header->clock;
+        } else {
+            nfallbacks++;
+        }
+        unlock();
+        return slot;
+    }
+
+    /* the block `blk` acquired with `fill` has been loaded into its slot */
+    void ready(bid_t blk) {
+        lock();
+        entries[blk].state = SHARED_READY;
+        unlock();
+    }
+
+    /* drop the reference of the block `blk` */
+    void release(bid_t blk) {
+        lock();
+        if(entries[blk].refs > 0) entries[blk].refs--;
+        unlock();
+    }
+};
+
+#endif
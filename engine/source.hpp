@@ -0,0 +1,265 @@
+#ifndef _GRAPH_SOURCE_H_
+#define _GRAPH_SOURCE_H_
+
+#include <omp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <fstream>
+#include <algorithm>
+#include "api/types.hpp"
+#include "util/util.hpp"
+#include "util/io.hpp"
+#include "util/radixsort.hpp"
+#include "logger/logger.hpp"
+#include "cache.hpp"
+
+#define SOURCE_SWEEP_VERTS (1 << 20)    /* the vertices of the beg_pos range read at a time by the degree sampling */
+
+/** walk_source, range_walk_source, list_walk_source
+ *
+ * This file contribute to define the lazy start walks. An app declares where its walks start instead of moving
+ * all of them into the buckets at the prologue, the start walks of each block are only counted, and generated
+ * when the scheduler first runs the block pair (blk, blk), so the prologue spills nothing and the first step
+ * does not wait for the whole initialization. The pending start walks are counted in the walks of the pair
+ * (blk, blk), the schedulers see them as any other walks.
+ *
+ * `range_walk_source` : `wps` walks from each vertex of [first, last), the k-th walk of `v` has the id (v - first) * wps + k
+ * `list_walk_source`  : `wps` walks from each listed vertex, the k-th walk of the i-th vertex has the id i * wps + k,
+ *                       the list is read from a file (`load_walk_sources`), or sampled uniformly (`sample_walk_sources`)
+ *                       or by the out-degree (`sample_degree_walk_sources`) from counter based random streams, so a
+ *                       seed gives the same list at any thread count
+ *
+ * `create_walk_source` picks one of them from the options of the app.
+ */
+
+class walk_source {
+protected:
+    const graph_block *blocks;
+    std::vector<wid_t> generated;   /* the start walks of each block generated so far */
+
+public:
+    walk_source() : blocks(NULL) { }
+    virtual ~walk_source() { }
+
+    /* bind the source to the blocks */
+    virtual void setup(const graph_block &_blocks) {
+        blocks = &_blocks;
+        generated.assign(blocks->nblocks, 0);
+    }
+
+    /* the start walks of block `blk` */
+    virtual wid_t count(bid_t blk) const = 0;
+
+    /* the `n`-th start walk of block `blk` */
+    virtual walker_t walk(bid_t blk, wid_t n) const = 0;
+
+    /* the walk ids of the source are [0, nids()) */
+    virtual uint64_t nids() const = 0;
+
+    wid_t pending(bid_t blk) const { return count(blk) - generated[blk]; }
+
+    wid_t total_generated() const {
+        wid_t total = 0;
+        for(wid_t n : generated) total += n;
+        return total;
+    }
+
+    /* write at most `max` pending start walks of block `blk` into `out`, return the number of walks */
+    wid_t generate(bid_t blk, wid_t max, walker_t *out) {
+        wid_t n = std::min(max, pending(blk)), first = generated[blk];
+        #pragma omp parallel for schedule(static)
+        for(wid_t i = 0; i < n; i++) out[i] = walk(blk, first + i);
+        generated[blk] += n;
+        return n;
+    }
+
+    /* the generation progress, saved and restored by the checkpoint */
+    virtual void dump_state(std::ostream &os) {
+        os.write(reinterpret_cast<const char *>(generated.data()), generated.size() * sizeof(wid_t));
+    }
+
+    virtual void load_state(std::istream &is) {
+        is.read(reinterpret_cast<char *>(generated.data()), generated.size() * sizeof(wid_t));
+    }
+};
+
+class range_walk_source : public walk_source {
+private:
+    vid_t first, last;
+    wid_t wps;
+
+    vid_t begin(bid_t blk) const { return std::max(first, blocks->blocks[blk].start_vert); }
+    vid_t end(bid_t blk) const { return std::min(last, blocks->blocks[blk].start_vert + blocks->blocks[blk].nverts); }
+
+public:
+    range_walk_source(vid_t _first, vid_t _last, wid_t _wps) : first(_first), last(_last), wps(_wps) { }
+
+    wid_t count(bid_t blk) const {
+        return begin(blk) < end(blk) ? (wid_t)(end(blk) - begin(blk)) * wps : 0;
+    }
+
+    uint64_t nids() const { return last > first ? (uint64_t)(last - first) * wps : 0; }
+
+    walker_t walk(bid_t blk, wid_t n) const {
+        vid_t vertex = begin(blk) + n / wps;
+        return walker_makeup((wid_t)(vertex - first) * wps + n % wps, vertex, vertex, vertex, 0, blk, blk);
+    }
+};
+
+class list_walk_source : public walk_source {
+private:
+    std::vector<vid_t> vertices;    /* the listed start vertices */
+    std::vector<wid_t> offsets;     /* the listed vertices of block `blk` are order[offsets[blk], offsets[blk + 1]) */
+    std::vector<wid_t> order;       /* the list positions grouped by block */
+    wid_t wps;
+
+    /**
+     * group the list positions by block in bulk, the positions are sorted by vertex with the parallel radix sort,
+     * then the blocks, which are sorted vertex ranges, take their runs by a binary search of their first vertices.
+     * the walks of a block start vertex by vertex.
+     */
+    void group() {
+        bid_t nblocks = blocks->nblocks;
+        wid_t n = vertices.size();
+        const std::vector<vid_t> &list = vertices;
+        std::vector<wid_t> tmp(n);
+        order.resize(n);
+        #pragma omp parallel for schedule(static)
+        for(wid_t i = 0; i < n; i++) order[i] = i;
+        const block_t &last = blocks->blocks[nblocks - 1];
+        unsigned vertex_bits = walker_layout_t::bit_width(last.start_vert + last.nverts - 1);
+        if(parallel_radix_sort(order.data(), tmp.data(), n, vertex_bits, [&list](wid_t i) { return (uint64_t)list[i]; })) order.swap(tmp);
+
+        offsets.assign(nblocks + 1, n);
+        for(bid_t blk = 0; blk < nblocks; blk++) {
+            vid_t start = blocks->blocks[blk].start_vert;
+            offsets[blk] = std::lower_bound(order.begin(), order.end(), start, [&list](wid_t i, vid_t v) { return list[i] < v; }) - order.begin();
+        }
+    }
+
+public:
+    list_walk_source(std::vector<vid_t> &&_vertices, wid_t _wps) : vertices(std::move(_vertices)), wps(_wps) { }
+
+    void setup(const graph_block &_blocks) {
+        walk_source::setup(_blocks);
+        group();
+    }
+
+    wid_t count(bid_t blk) const {
+        return (offsets[blk + 1] - offsets[blk]) * wps;
+    }
+
+    uint64_t nids() const { return (uint64_t)vertices.size() * wps; }
+
+    walker_t walk(bid_t blk, wid_t n) const {
+        wid_t idx = order[offsets[blk] + n / wps];
+        vid_t vertex = vertices[idx];
+        return walker_makeup(idx * wps + n % wps, vertex, vertex, vertex, 0, blk, blk);
+    }
+
+    /* the list is saved along with the progress, a sampled list is not sampled again when resuming */
+    void dump_state(std::ostream &os) {
+        uint64_t nvertices = vertices.size();
+        os.write(reinterpret_cast<const char *>(&nvertices), sizeof(uint64_t));
+        os.write(reinterpret_cast<const char *>(vertices.data()), nvertices * sizeof(vid_t));
+        walk_source::dump_state(os);
+    }
+
+    void load_state(std::istream &is) {
+        uint64_t nvertices = 0;
+        is.read(reinterpret_cast<char *>(&nvertices), sizeof(uint64_t));
+        vertices.resize(nvertices);
+        is.read(reinterpret_cast<char *>(vertices.data()), nvertices * sizeof(vid_t));
+        group();
+        walk_source::load_state(is);
+    }
+};
+
+/* the start vertices listed in the text file `name`, the vertices out of [0, nvertices) are dropped */
+inline std::vector<vid_t> load_walk_sources(const std::string &name, vid_t nvertices) {
+    std::vector<vid_t> vertices;
+    std::ifstream in(name);
+    if(!in.good()) {
+        logstream(LOG_FATAL) << "can not open the walk source file " << name << std::endl;
+        return vertices;
+    }
+    uint64_t vertex, ndropped = 0;
+    while(in >> vertex) {
+        if(vertex < nvertices) vertices.push_back(vertex);
+        else ndropped++;
+    }
+    if(ndropped > 0) logstream(LOG_WARNING) << "drop " << ndropped << " walk sources out of the " << nvertices << " vertices" << std::endl;
+    logstream(LOG_INFO) << "load " << vertices.size() << " walk sources from " << name << std::endl;
+    return vertices;
+}
+
+/* `nsources` start vertices sampled uniformly at random, the i-th vertex is drawn from the i-th value of the stream `seed` */
+inline std::vector<vid_t> sample_walk_sources(wid_t nsources, vid_t nvertices, uint64_t seed) {
+    std::vector<vid_t> vertices(nsources);
+    #pragma omp parallel for schedule(static)
+    for(wid_t i = 0; i < nsources; i++) vertices[i] = counter_rand(seed, i) % nvertices;
+    return vertices;
+}
+
+/**
+ * `nsources` start vertices sampled in proportion to their out-degree, the i-th vertex owns the i-th edge drawn
+ * from the stream `seed`. the draws are sorted by edge, then the beg_pos file of `base_name` is swept
+ * `SOURCE_SWEEP_VERTS` vertices at a time and each draw is found by a binary search of the edge offsets of its
+ * range, so only one range of the beg_pos is in memory.
+ */
+inline std::vector<vid_t> sample_degree_walk_sources(wid_t nsources, const std::string &base_name, vid_t nvertices, uint64_t seed) {
+    std::vector<vid_t> vertices;
+    int desc = open(get_beg_pos_name(base_name).c_str(), O_RDONLY);
+    if(desc < 0) {
+        logstream(LOG_FATAL) << "can not open the beg_pos file of " << base_name << std::endl;
+        return vertices;
+    }
+    eid_t head = 0, tail = 0;
+    load_block_range(desc, &head, 1, 0);
+    load_block_range(desc, &tail, 1, (size_t)nvertices * sizeof(eid_t));
+    eid_t nedges = tail - head;
+    if(nedges == 0) {
+        close(desc);
+        logstream(LOG_WARNING) << "the graph has no edge, sample the walk sources uniformly" << std::endl;
+        return sample_walk_sources(nsources, nvertices, seed);
+    }
+
+    auto edge = [seed, nedges](wid_t i) { return (uint64_t)(counter_rand(seed, i) % nedges); };
+    std::vector<wid_t> order(nsources), tmp(nsources);
+    #pragma omp parallel for schedule(static)
+    for(wid_t i = 0; i < nsources; i++) order[i] = i;
+    if(parallel_radix_sort(order.data(), tmp.data(), nsources, walker_layout_t::bit_width(nedges - 1), edge)) order.swap(tmp);
+    std::vector<wid_t>().swap(tmp);
+
+    vertices.resize(nsources);
+    std::vector<eid_t> beg_pos(SOURCE_SWEEP_VERTS + 1);
+    wid_t pos = 0;
+    for(uint64_t first = 0; first < nvertices && pos < nsources; first += SOURCE_SWEEP_VERTS) {
+        size_t n = std::min<uint64_t>(nvertices - first, SOURCE_SWEEP_VERTS);
+        load_block_range(desc, beg_pos.data(), n + 1, first * sizeof(eid_t));
+        wid_t end = pos;
+        while(end < nsources && head + edge(order[end]) < beg_pos[n]) end++;
+        #pragma omp parallel for schedule(static)
+        for(wid_t k = pos; k < end; k++) {
+            eid_t e = head + edge(order[k]);
+            vertices[order[k]] = first + (std::upper_bound(beg_pos.begin(), beg_pos.begin() + n + 1, e) - beg_pos.begin() - 1);
+        }
+        pos = end;
+    }
+    close(desc);
+    return vertices;
+}
+
+inline walk_source *create_walk_source(const graph_config &conf, const std::string &file, wid_t nsources, const std::string &dist, wid_t wps, uint64_t seed) {
+    if(!file.empty()) return new list_walk_source(load_walk_sources(file, conf.nvertices), wps);
+    if(nsources == 0) return new range_walk_source(0, conf.nvertices, wps);
+    if(dist == "degree") return new list_walk_source(sample_degree_walk_sources(nsources, conf.base_name, conf.nvertices, seed), wps);
+    if(dist != "uniform") logstream(LOG_WARNING) << "unknown source distribution " << dist << ", use uniform" << std::endl;
+    return new list_walk_source(sample_walk_sources(nsources, conf.nvertices, seed), wps);
+}
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef _GRAPH_STORAGE_H_
+#define _GRAPH_STORAGE_H_
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include "api/types.hpp"
+#include "util/util.hpp"
+#include "logger/logger.hpp"
+#include "config.hpp"
+
+/** graph_storage
+ *
+ * This file contribute to define where the block data and the walk files are placed when several storage
+ * roots (e.g. one directory on each NVMe drive) are given.
+ *
+ * block `b`           : `<root[b % nroots]>/<b>.block`, the beg_pos, csr (and weights) of the block,
+ *                       copied from the dataset files when the block is loaded for the first time
+ * walk file of (p, c) : on the root after the root of block `c`, or the next one if it is the root of block `p`
+ *                       and there are three roots at least, so the walks of a pair are not read from the devices
+ *                       that hold the graph data of its blocks
+ *
+ * Without storage roots, the blocks are read from the dataset files and the walk files are placed in the
+ * dataset block folder as before.
+ */
+
+class graph_storage {
+public:
+    std::string base_name;
+    size_t blocksize;
+    std::vector<std::string> folders;   /* the block folder under each storage root */
+
+    graph_storage() : blocksize(0) { }
+
+    void setup(const graph_config &conf) {
+        base_name = conf.base_name;
+        blocksize = conf.blocksize;
+        folders.clear();
+
+        std::stringstream ss(conf.storage_roots);
+        std::string root;
+        while(std::getline(ss, root, ',')) {
+            if(root.empty()) continue;
+            std::string folder = get_storage_block_folder(root, base_name, blocksize);
+            if(!test_folder_exists(folder) && sowalker_mkdir(folder.c_str()) != 0) {
+                logstream(LOG_FATAL) << "can not create the storage folder " << folder << std::endl;
+            }
+            folders.push_back(folder);
+        }
+    }
+
+    /* the storage roots listed in the comma separated `roots`, at least 1 for the dataset folder */
+    static size_t count_roots(const std::string &roots) {
+        std::stringstream ss(roots);
+        std::string root;
+        size_t n = 0;
+        while(std::getline(ss, root, ',')) {
+            if(!root.empty()) n++;
+        }
+        return std::max<size_t>(n, 1);
+    }
+
+    bool striped() const { return !folders.empty(); }
+    size_t nroots() const { return folders.empty() ? 1 : folders.size(); }
+
+    size_t block_root(bid_t blk) const { return blk % nroots(); }
+
+    std::string block_name(bid_t blk) const {
+        return folders[block_root(blk)] + "/" + std::to_string(blk) + ".block";
+    }
+
+    /* the root of the walk file of the block pair (`prev_blk`, `cur_blk`) */
+    size_t walk_root(bid_t prev_blk, bid_t cur_blk) const {
+        size_t root = (block_root(cur_blk) + 1) % nroots();
+        if(nroots() >= 3 && root == block_root(prev_blk)) root = (root + 1) % nroots();
+        return root;
+    }
+
+    /* the walk file of block pair `blk`, whose previous and current blocks are `prev_blk` and `cur_blk` */
+    std::string walk_name(bid_t blk, bid_t prev_blk, bid_t cur_blk) const {
+        if(!striped()) return get_walk_name(base_name, blocksize, blk);
+        return folders[walk_root(prev_blk, cur_blk)] + "/" + std::to_string(blk) + ".walk";
+    }
+};
+
+#endif
@@ -0,0 +1,452 @@
+#ifndef _GRAPH_STREAM_H_
+#define _GRAPH_STREAM_H_
+
+#include <atomic>
+#include <mutex>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sched.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "api/types.hpp"
+#include "util/util.hpp"
+#include "util/timer.hpp"
+#include "logger/logger.hpp"
+#include "trajectory.hpp"
+
+/** graph_stream
+ *
+ * This file contribute to define the streaming of the walk steps to a local consumer process, e.g. a
+ * skip-gram trainer, so that walking and training can run at the same time.
+ *
+ * The steps are published as `trajectory_record_t` records into a POSIX shared memory segment, which
+ * holds one single-producer single-consumer ring per walking thread. The producer thread owns the head
+ * of its ring and the consumer owns the tail, so no lock is needed, and the consumer reads the records
+ * in place. A walking thread waits when its ring is full, which throttles the engine to the speed of
+ * the consumer, so the engine does not finish before a consumer has read all the records. When the
+ * shared memory can not be created, the records are written into a named pipe instead, whose blocking
+ * writes throttle the engine in the same way.
+ *
+ * The consumer writes its process id into the header when it attaches. A waiting producer fails if no consumer
+ * has attached within `STREAM_ATTACH_SECONDS`, or if the attached consumer has exited, so a missing or crashed
+ * consumer does not hang the engine. A closed pipe fails the write instead of raising SIGPIPE.
+ *
+ * shared memory layout : stream_header_t | stream_ring_t of each thread | the records of each ring
+ */
+
+#define STREAM_MAGIC 0x32304d5254574f53ULL  /* "SOWTRM02" */
+#define STREAM_RING_RECORDS (256 * 1024)    /* the capacity of each ring, must be a power of 2 */
+#define STREAM_PUBLISH_RECORDS 256          /* the producer publishes its head every `STREAM_PUBLISH_RECORDS` records */
+#define STREAM_CACHE_LINE 64
+#define STREAM_ATTACH_SECONDS 120           /* a waiting producer fails if no consumer has attached in 120 seconds */
+
+struct stream_header_t {
+    std::atomic<uint64_t> magic;    /* set after the rings are initialized */
+    uint32_t nrings;
+    uint32_t record_size;
+    uint64_t capacity;
+    int32_t producer;               /* the process id of the producer */
+    std::atomic<uint32_t> closed;   /* no more records will be published */
+    std::atomic<int32_t> consumer;  /* the process id of the consumer, 0 before it attaches */
+};
+
+struct stream_ring_t {
+    std::atomic<uint64_t> head;     /* the number of records published by the producer */
+    char pad0[STREAM_CACHE_LINE - sizeof(std::atomic<uint64_t>)];
+    std::atomic<uint64_t> tail;     /* the number of records released by the consumer */
+    char pad1[STREAM_CACHE_LINE - sizeof(std::atomic<uint64_t>)];
+};
+
+inline size_t stream_segment_bytes(uint32_t nrings, uint64_t capacity) {
+    return STREAM_CACHE_LINE + nrings * sizeof(stream_ring_t) + nrings * capacity * sizeof(trajectory_record_t);
+}
+
+inline std::string stream_shm_name(const std::string &name) {
+    return name[0] == '/' ? name : "/" + name;
+}
+
+inline std::string stream_fifo_name(const std::string &name) {
+    return "/tmp/" + (name[0] == '/' ? name.substr(1) : name) + ".fifo";
+}
+
+/* write all the bytes into the pipe, return false if the consumer has gone */
+inline bool stream_write_all(int fd, const void *buf, size_t nbytes) {
+    const char *ptr = static_cast<const char *>(buf);
+    while(nbytes > 0) {
+        ssize_t ret = write(fd, ptr, nbytes);
+        if(ret < 0 && errno == EINTR) continue;
+        if(ret <= 0) return false;
+        ptr += ret;
+        nbytes -= ret;
+    }
+    return true;
+}
+
+class graph_stream {
+private:
+    /* the producer side state of a ring, only touched by its walking thread */
+    struct stream_cursor_t {
+        uint64_t head, published, tail;
+        size_t stalls;
+        char pad[STREAM_CACHE_LINE - 3 * sizeof(uint64_t) - sizeof(size_t)];
+    };
+
+    std::string name;
+    tid_t nthreads;
+    bool use_fifo;
+
+    /* shared memory */
+    void *segment;
+    size_t segment_bytes;
+    stream_header_t *header;
+    stream_ring_t *rings;
+    trajectory_record_t *records;
+    std::vector<stream_cursor_t> cursors;
+
+    /* named pipe */
+    int fifo_fd;
+    std::mutex fifo_mtx;
+    std::vector<std::vector<trajectory_record_t>> fifo_bufs;
+
+    void wait_for_space(tid_t t) {
+        stream_cursor_t &cur = cursors[t];
+        cur.tail = rings[t].tail.load(std::memory_order_acquire);
+        if(cur.head - cur.tail < STREAM_RING_RECORDS) return;
+
+        /* the consumer can not see the records that have not been published */
+        publish(t);
+        cur.stalls++;
+        unsigned backoff = 0;
+        graph_timer waited;
+        waited.start_time();
+        while(cur.head - (cur.tail = rings[t].tail.load(std::memory_order_acquire)) >= STREAM_RING_RECORDS) {
+            if(++backoff < 64) sched_yield();
+            else usleep(100);
+            if(backoff % 1024 == 0) check_consumer(waited.runtime());
+        }
+    }
+
+    /* fail if no consumer has attached in `STREAM_ATTACH_SECONDS` of waiting, or the attached consumer has exited */
+    void check_consumer(double waited) {
+        int32_t consumer = header->consumer.load(std::memory_order_acquire);
+        if(consumer == 0 && waited > STREAM_ATTACH_SECONDS) {
+            logstream(LOG_FATAL) << "no consumer has attached to " << stream_shm_name(name) << " in " << STREAM_ATTACH_SECONDS << " seconds." << std::endl;
+        }
+        if(consumer != 0 && kill(consumer, 0) != 0 && errno == ESRCH) {
+            logstream(LOG_FATAL) << "the consumer of " << stream_shm_name(name) << " has exited without reading the stream." << std::endl;
+        }
+    }
+
+    void publish(tid_t t) {
+        rings[t].head.store(cursors[t].head, std::memory_order_release);
+        cursors[t].published = cursors[t].head;
+    }
+
+    /* wait for the consumer to open the pipe, a non-blocking open fails with ENXIO until it does */
+    void open_fifo() {
+        if(fifo_fd >= 0) return;
+        logstream(LOG_INFO) << "waiting for the consumer to open " << stream_fifo_name(name) << std::endl;
+        graph_timer waited;
+        waited.start_time();
+        while((fifo_fd = open(stream_fifo_name(name).c_str(), O_WRONLY | O_NONBLOCK)) < 0) {
+            if(errno != ENXIO && errno != EINTR) {
+                logstream(LOG_FATAL) << "can not open the named pipe " << stream_fifo_name(name) << ", " << strerror(errno) << std::endl;
+            }
+            if(waited.runtime() > STREAM_ATTACH_SECONDS) {
+                logstream(LOG_FATAL) << "no consumer has opened " << stream_fifo_name(name) << " in " << STREAM_ATTACH_SECONDS << " seconds." << std::endl;
+            }
+            usleep(10000);
+        }
+        /* the writes block again, so the consumer throttles the engine */
+        fcntl(fifo_fd, F_SETFL, fcntl(fifo_fd, F_GETFL) & ~O_NONBLOCK);
+    }
+
+    void write_fifo(tid_t t) {
+        std::vector<trajectory_record_t> &buf = fifo_bufs[t];
+        if(buf.empty()) return;
+        std::lock_guard<std::mutex> lock(fifo_mtx);
+        open_fifo();
+        if(!stream_write_all(fifo_fd, buf.data(), buf.size() * sizeof(trajectory_record_t))) {
+            logstream(LOG_FATAL) << "the consumer of " << stream_fifo_name(name) << " has closed the stream." << std::endl;
+        }
+        cursors[t].head += buf.size();
+        buf.clear();
+    }
+
+    bool create_segment() {
+        std::string shm_name = stream_shm_name(name);
+        shm_unlink(shm_name.c_str());
+        int fd = shm_open(shm_name.c_str(), O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+        if(fd < 0) return false;
+        segment_bytes = stream_segment_bytes(nthreads, STREAM_RING_RECORDS);
+        if(ftruncate(fd, segment_bytes) != 0) {
+            ::close(fd);
+            shm_unlink(shm_name.c_str());
+            return false;
+        }
+        segment = mmap(NULL, segment_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if(segment == MAP_FAILED) {
+            shm_unlink(shm_name.c_str());
+            return false;
+        }
+
+        header = new (segment) stream_header_t;
+        header->nrings = nthreads;
+        header->record_size = sizeof(trajectory_record_t);
+        header->capacity = STREAM_RING_RECORDS;
+        header->producer = getpid();
+        header->closed.store(0);
+        header->consumer.store(0);
+        rings = reinterpret_cast<stream_ring_t *>(static_cast<char *>(segment) + STREAM_CACHE_LINE);
+        for(tid_t t = 0; t < nthreads; t++) {
+            new (&rings[t]) stream_ring_t;
+            rings[t].head.store(0);
+            rings[t].tail.store(0);
+        }
+        records = reinterpret_cast<trajectory_record_t *>(rings + nthreads);
+        header->magic.store(STREAM_MAGIC, std::memory_order_release);
+        return true;
+    }
+
+public:
+    graph_stream(const std::string &stream_name, tid_t threads, bool fifo) {
+        name = stream_name;
+        nthreads = threads;
+        use_fifo = fifo;
+        segment = NULL;
+        segment_bytes = 0;
+        header = NULL;
+        rings = NULL;
+        records = NULL;
+        fifo_fd = -1;
+        stream_cursor_t zero;
+        memset(&zero, 0, sizeof(zero));
+        cursors.resize(nthreads, zero);
+
+        if(!use_fifo && !create_segment()) {
+            logstream(LOG_WARNING) << "can not create the shared memory " << stream_shm_name(name) << ", fall back to the named pipe." << std::endl;
+            use_fifo = true;
+        }
+        if(use_fifo) {
+            std::string fifo_name = stream_fifo_name(name);
+            unlink(fifo_name.c_str());
+            if(mkfifo(fifo_name.c_str(), S_IRUSR | S_IWUSR) != 0) {
+                logstream(LOG_FATAL) << "can not create the named pipe " << fifo_name << std::endl;
+            }
+            /* a closed pipe fails the write, which reports the gone consumer, instead of killing the engine */
+            signal(SIGPIPE, SIG_IGN);
+            fifo_bufs.resize(nthreads);
+            for(tid_t t = 0; t < nthreads; t++) fifo_bufs[t].reserve(STREAM_PUBLISH_RECORDS * 16);
+            logstream(LOG_INFO) << "stream the walk steps into the named pipe " << fifo_name << std::endl;
+        } else {
+            logstream(LOG_INFO) << "stream the walk steps into the shared memory " << stream_shm_name(name) << std::endl;
+        }
+    }
+
+    ~graph_stream() {
+        close();
+        if(segment) {
+            munmap(segment, segment_bytes);
+            shm_unlink(stream_shm_name(name).c_str());
+        }
+        if(use_fifo) unlink(stream_fifo_name(name).c_str());
+    }
+
+    void record(tid_t t, wid_t id, hid_t hop, vid_t vertex) {
+        trajectory_record_t rec = { id, hop, vertex };
+        if(use_fifo) {
+            fifo_bufs[t].push_back(rec);
+            if(fifo_bufs[t].size() >= STREAM_PUBLISH_RECORDS * 16) write_fifo(t);
+            return;
+        }
+        stream_cursor_t &cur = cursors[t];
+        if(cur.head - cur.tail >= STREAM_RING_RECORDS) wait_for_space(t);
+        records[t * STREAM_RING_RECORDS + (cur.head & (STREAM_RING_RECORDS - 1))] = rec;
+        cur.head++;
+        if(cur.head - cur.published >= STREAM_PUBLISH_RECORDS) publish(t);
+    }
+
+    /* publish the pending records of all the threads, must not run along with `record` */
+    void flush() {
+        for(tid_t t = 0; t < nthreads; t++) {
+            if(use_fifo) write_fifo(t);
+            else publish(t);
+        }
+    }
+
+    /* publish the remaining records, and wait for the consumer to read all of them */
+    void close() {
+        if(use_fifo) {
+            if(fifo_bufs.empty()) return;
+            /* the consumer only sees the end of the stream after the pipe has been opened */
+            open_fifo();
+            flush();
+            if(fifo_fd >= 0) ::close(fifo_fd);
+            fifo_fd = -1;
+            fifo_bufs.clear();
+            return;
+        }
+        if(header == NULL || header->closed.load()) return;
+        flush();
+        header->closed.store(1, std::memory_order_release);
+        graph_timer waited;
+        waited.start_time();
+        for(tid_t t = 0; t < nthreads; t++) {
+            for(unsigned backoff = 1; rings[t].tail.load(std::memory_order_acquire) < cursors[t].head; backoff++) {
+                usleep(100);
+                if(backoff % 1024 == 0) check_consumer(waited.runtime());
+            }
+        }
+    }
+
+    size_t total_records() const {
+        size_t total = 0;
+        for(tid_t t = 0; t < nthreads; t++) total += cursors[t].head;
+        return total;
+    }
+
+    size_t total_stalls() const {
+        size_t total = 0;
+        for(tid_t t = 0; t < nthreads; t++) total += cursors[t].stalls;
+        return total;
+    }
+};
+
+/** walk_stream_reader
+ *
+ * The consumer side of `graph_stream`. `next` returns a contiguous range of records, which points into
+ * the shared memory, and `release` gives the range back to the producer.
+ */
+class walk_stream_reader {
+private:
+    std::string name;
+    bool use_fifo;
+
+    void *segment;
+    size_t segment_bytes;
+    stream_header_t *header;
+    stream_ring_t *rings;
+    trajectory_record_t *records;
+    uint32_t nrings, ring;
+
+    int fifo_fd;
+    std::vector<trajectory_record_t> fifo_buf;
+    size_t fifo_pending;    /* the bytes of a partial record left at the end of the last read */
+
+public:
+    walk_stream_reader(const std::string &stream_name, bool fifo) {
+        name = stream_name;
+        use_fifo = fifo;
+        segment = NULL;
+        segment_bytes = 0;
+        header = NULL;
+        rings = NULL;
+        records = NULL;
+        nrings = ring = 0;
+        fifo_fd = -1;
+        fifo_pending = 0;
+    }
+
+    ~walk_stream_reader() {
+        if(segment) munmap(segment, segment_bytes);
+        if(fifo_fd >= 0) close(fifo_fd);
+    }
+
+    /* wait for the producer to create the stream */
+    void attach() {
+        if(use_fifo) {
+            std::string fifo_name = stream_fifo_name(name);
+            while(!test_exists(fifo_name)) usleep(10000);
+            fifo_fd = open(fifo_name.c_str(), O_RDONLY);
+            assert(fifo_fd >= 0);
+            fifo_buf.resize(STREAM_PUBLISH_RECORDS * 64);
+            return;
+        }
+
+        std::string shm_name = stream_shm_name(name);
+        int fd = -1;
+        struct stat st;
+        while(true) {
+            fd = shm_open(shm_name.c_str(), O_RDWR, S_IRUSR | S_IWUSR);
+            if(fd >= 0 && fstat(fd, &st) == 0 && st.st_size >= STREAM_CACHE_LINE) break;
+            if(fd >= 0) close(fd);
+            usleep(10000);
+        }
+        segment_bytes = st.st_size;
+        segment = mmap(NULL, segment_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        assert(segment != MAP_FAILED);
+        header = static_cast<stream_header_t *>(segment);
+        while(header->magic.load(std::memory_order_acquire) != STREAM_MAGIC) usleep(1000);
+        header->consumer.store(getpid(), std::memory_order_release);
+        assert(header->record_size == sizeof(trajectory_record_t) && header->capacity == STREAM_RING_RECORDS);
+        nrings = header->nrings;
+        rings = reinterpret_cast<stream_ring_t *>(static_cast<char *>(segment) + STREAM_CACHE_LINE);
+        records = reinterpret_cast<trajectory_record_t *>(rings + nrings);
+    }
+
+    /**
+     * wait for the next records, `recs` points to the records and `ring_id` is the ring they belong to,
+     * return the number of records, 0 means the stream has been closed and all the records have been read.
+     */
+    size_t next(const trajectory_record_t *&recs, uint32_t &ring_id) {
+        if(use_fifo) {
+            char *buf = reinterpret_cast<char *>(fifo_buf.data());
+            size_t nbytes = fifo_pending;
+            while(nbytes < sizeof(trajectory_record_t)) {
+                ssize_t ret = read(fifo_fd, buf + nbytes, fifo_buf.size() * sizeof(trajectory_record_t) - nbytes);
+                if(ret < 0 && errno == EINTR) continue;
+                if(ret <= 0) return 0;
+                nbytes += ret;
+            }
+            fifo_pending = nbytes % sizeof(trajectory_record_t);
+            recs = fifo_buf.data();
+            ring_id = 0;
+            return nbytes / sizeof(trajectory_record_t);
+        }
+
+        unsigned backoff = 0;
+        while(true) {
+            bool closed = header->closed.load(std::memory_order_acquire);
+            for(uint32_t k = 0; k < nrings; k++, ring = (ring + 1) % nrings) {
+                uint64_t head = rings[ring].head.load(std::memory_order_acquire);
+                uint64_t tail = rings[ring].tail.load(std::memory_order_relaxed);
+                if(head == tail) continue;
+                uint64_t pos = tail & (header->capacity - 1);
+                recs = records + ring * header->capacity + pos;
+                ring_id = ring;
+                return std::min(head - tail, header->capacity - pos);
+            }
+            /* the heads are published before `closed`, so all the records have been read */
+            if(closed) return 0;
+            if(++backoff < 64) {
+                sched_yield();
+            } else {
+                /* the stream will never be closed if the producer has exited abnormally */
+                if(backoff % 1024 == 0 && kill(header->producer, 0) != 0 && errno == ESRCH) {
+                    logstream(LOG_ERROR) << "the producer of " << stream_shm_name(name) << " has exited without closing the stream." << std::endl;
+                    return 0;
+                }
+                usleep(100);
+            }
+        }
+    }
+
+    /* give the `count` records returned by `next` back to the producer */
+    void release(uint32_t ring_id, size_t count) {
+        if(use_fifo) {
+            /* move the partial record to the front of the buffer */
+            char *buf = reinterpret_cast<char *>(fifo_buf.data());
+            memmove(buf, buf + count * sizeof(trajectory_record_t), fifo_pending);
+            return;
+        }
+        rings[ring_id].tail.fetch_add(count, std::memory_order_release);
+        ring = (ring_id + 1) % nrings;
+    }
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef _GRAPH_TAIL_H_
+#define _GRAPH_TAIL_H_
+
+#include <omp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+#include "api/types.hpp"
+#include "util/io.hpp"
+#include "util/bitpack.hpp"
+#include "util/aligned.hpp"
+#include "config.hpp"
+
+/** graph_tail_reader
+ *
+ * This file contribute to define the direct adjacency reads of the tail of a run. When only a few walks are left,
+ * loading a whole block for the few vertices they visit costs more than reading those adjacency lists, so in the
+ * tail mode a walk at a vertex of an uncached block reads the list of the vertex from the dataset files and keeps
+ * stepping, instead of waiting for a round that loads the block.
+ *
+ * Each thread reads into its own ring of `TAIL_LISTS` buffers, padded to a cache line, a list stays valid until the
+ * thread reads `TAIL_LISTS` more lists. The walk update code holds two lists at most (the current and the previous
+ * vertex), and carries the list of the current vertex over as the previous list of the next step, so a step reads
+ * one list. The first step of a walk reads two, the ring of three keeps its current list until the next step is done.
+ */
+
+#define TAIL_LISTS 3
+
+class graph_tail_reader {
+private:
+    int vertdesc, edgedesc;
+    struct alignas(CACHE_LINE_SIZE) ring_t {
+        std::vector<vid_t> bufs[TAIL_LISTS];
+        uint32_t next;                      /* the next buffer of the ring */
+        ring_t() : next(0) { }
+    };
+    std::vector<ring_t, cache_line_allocator<ring_t>> rings;   /* the ring of each thread */
+
+public:
+    size_t nreads, nbytes;                  /* the adjacency lists read and their bytes */
+
+    graph_tail_reader() : vertdesc(-1), edgedesc(-1), nreads(0), nbytes(0) { }
+
+    ~graph_tail_reader() {
+        if(vertdesc >= 0) close(vertdesc);
+        if(edgedesc >= 0) close(edgedesc);
+    }
+
+    void setup(graph_config *conf) {
+        tid_t nthreads = std::max(conf->nthreads, conf->max_nthreads);
+        rings.resize(nthreads);
+        vertdesc = open(get_beg_pos_name(conf->base_name).c_str(), O_RDONLY);
+        edgedesc = open(get_csr_name(conf->base_name).c_str(), O_RDONLY);
+    }
+
+    bool ready() const { return vertdesc >= 0 && edgedesc >= 0; }
+
+    /* read the adjacency list of `v` into the ring of the calling thread */
+    bool read(vid_t v, adj_list &list) {
+        if(!ready()) return false;
+        tid_t t = static_cast<tid_t>(omp_get_thread_num());
+        ring_t &ring = rings[t];
+        std::vector<vid_t> &buf = ring.bufs[ring.next];
+        ring.next = (ring.next + 1) % TAIL_LISTS;
+        eid_t range[2];
+        load_block_range(vertdesc, range, 2, v * sizeof(eid_t));
+        eid_t deg = range[1] - range[0];
+        buf.resize(deg);
+        if(deg > 0) load_block_range(edgedesc, buf.data(), deg, range[0] * sizeof(vid_t));
+        __sync_fetch_and_add(&nreads, 1);
+        __sync_fetch_and_add(&nbytes, 2 * sizeof(eid_t) + deg * sizeof(vid_t));
+        list = adj_list(buf.data(), deg);
+        return true;
+    }
+};
+
+#endif
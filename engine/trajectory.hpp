@@ -0,0 +1,451 @@
+#ifndef _GRAPH_TRAJECTORY_H_
+#define _GRAPH_TRAJECTORY_H_
+
+#include <omp.h>
+#include <queue>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "api/types.hpp"
+#include "api/constants.hpp"
+#include "util/util.hpp"
+#include "util/io.hpp"
+#include "logger/logger.hpp"
+
+/** graph_trajectory
+ *
+ * This file contribute to define the walk trajectory output. Each step of a walk is recorded as a
+ * (walk id, hop, vertex) record into the buffer of the running thread. A full buffer is sorted by
+ * (walk id, hop) and appended to the trajectory file of the thread as one sorted run, so each thread
+ * only issues large sequential writes. A walk is updated by one thread at a time and its steps are
+ * recorded in hop order, so a stable radix sort on the walk id is enough to sort a buffer.
+ *
+ * At the end, the runs are merged in parallel: while there are more than `TRAJECTORY_MAX_FANIN` runs, groups of
+ * that many runs are first merged into one longer run each, so the final merge reads a bounded number of runs
+ * with large reads whatever the number of steps. Then the walk id space is split into one range per thread,
+ * each thread merges the records of its range from all the runs and writes the contiguous paths into
+ * a part file, and the part files are concatenated into the output.
+ *
+ * binary layout : trajectory_header_t | (walk id, length, vertex[length]) of each walk, ordered by walk id
+ * text layout   : one walk per line, the vertices are separated by a space
+ */
+
+#define TRAJECTORY_MAGIC 0x31304a5254574f53ULL  /* "SOWTRJ01" */
+#define TRAJECTORY_MERGE_BUFFER (64LL * 1024 * 1024)  /* the read buffer size of each merging thread */
+#define TRAJECTORY_WRITE_BUFFER (8LL * 1024 * 1024)   /* the output buffer size of each merging thread */
+#define TRAJECTORY_MAX_FANIN 128                      /* the runs merged at once */
+
+struct trajectory_record_t {
+    wid_t id;
+    uint32_t hop;
+    vid_t vertex;
+};
+
+struct trajectory_run_t {
+    uint64_t off, count;    /* the first record and the number of records of the run in the trajectory file */
+    wid_t first, last;      /* the smallest and the largest walk id in the run */
+};
+
+struct trajectory_header_t {
+    uint64_t magic;
+    uint64_t nwalks;
+    uint64_t nsteps;
+};
+
+inline bool trajectory_less(const trajectory_record_t &u, const trajectory_record_t &v) {
+    return u.id < v.id || (u.id == v.id && u.hop < v.hop);
+}
+
+/* read the records of one run in the range [pos, end) sequentially */
+class trajectory_cursor_t {
+public:
+    int fd;
+    uint64_t pos, end;
+    std::vector<trajectory_record_t> buf;
+    size_t index;
+
+    trajectory_cursor_t(int desc, uint64_t beg, uint64_t last, size_t nrecords) {
+        fd = desc;
+        pos = beg;
+        end = last;
+        buf.reserve(nrecords);
+        index = 0;
+        fill();
+    }
+
+    bool empty() const { return index >= buf.size(); }
+    const trajectory_record_t &top() const { return buf[index]; }
+
+    void pop() {
+        if(++index == buf.size()) fill();
+    }
+
+    void fill() {
+        size_t cnt = std::min(static_cast<uint64_t>(buf.capacity()), end - pos);
+        buf.resize(cnt);
+        index = 0;
+        if(cnt == 0) return;
+        load_block_range(fd, buf.data(), cnt, pos * sizeof(trajectory_record_t));
+        pos += cnt;
+    }
+};
+
+class graph_trajectory {
+public:
+    std::string base_name;
+    size_t blocksize;
+    tid_t nthreads;
+    std::vector<std::vector<trajectory_record_t>> bufs;     /* per thread record buffer */
+    std::vector<std::vector<trajectory_record_t>> sort_bufs;/* per thread radix sort buffer */
+    std::vector<std::vector<trajectory_run_t>> runs;        /* per thread sorted runs in the trajectory file */
+    std::vector<uint64_t> nrecords;                         /* per thread number of records in the trajectory file */
+
+    graph_trajectory(const std::string &name, size_t bsize, tid_t threads, bool keep_files) {
+        base_name = name;
+        blocksize = bsize;
+        nthreads = threads;
+        bufs.resize(nthreads);
+        sort_bufs.resize(nthreads);
+        runs.resize(nthreads);
+        nrecords.resize(nthreads, 0);
+        for(tid_t t = 0; t < nthreads; t++) {
+            bufs[t].reserve(MAX_TRECORDS);
+            if(!keep_files) test_delete(get_trajectory_name(base_name, blocksize, t));
+        }
+    }
+
+    ~graph_trajectory() {
+        for(tid_t t = 0; t < nthreads; t++) test_delete(get_trajectory_name(base_name, blocksize, t));
+    }
+
+    void record(tid_t t, wid_t id, hid_t hop, vid_t vertex) {
+        trajectory_record_t rec = { id, hop, vertex };
+        bufs[t].push_back(rec);
+        if(bufs[t].size() >= MAX_TRECORDS) spill(t);
+    }
+
+    /* sort the buffer of thread `t` and append it to the trajectory file as a new run */
+    void spill(tid_t t) {
+        std::vector<trajectory_record_t> &buf = bufs[t];
+        if(buf.empty()) return;
+        radix_sort(buf, sort_bufs[t]);
+
+        int fd = open(get_trajectory_name(base_name, blocksize, t).c_str(), O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
+        assert(fd >= 0);
+        dump_block_range(fd, buf.data(), buf.size(), nrecords[t] * sizeof(trajectory_record_t));
+        close(fd);
+
+        trajectory_run_t run = { nrecords[t], buf.size(), buf.front().id, buf.back().id };
+        runs[t].push_back(run);
+        nrecords[t] += buf.size();
+        buf.clear();
+    }
+
+    /* spill all the buffers, if `sync` the trajectory files are also flushed to the disk */
+    void flush(bool sync = false) {
+        #pragma omp parallel for num_threads(nthreads)
+        for(tid_t t = 0; t < nthreads; t++) {
+            spill(t);
+            if(sync && nrecords[t] > 0) {
+                int fd = open(get_trajectory_name(base_name, blocksize, t).c_str(), O_WRONLY);
+                fdatasync(fd);
+                close(fd);
+            }
+        }
+    }
+
+    /* drop the records of thread `t` after the first `count` records, used when resuming from a checkpoint */
+    void truncate(tid_t t, uint64_t count) {
+        bufs[t].clear();
+        nrecords[t] = count;
+        std::string name = get_trajectory_name(base_name, blocksize, t);
+        if(test_exists(name)) ::truncate(name.c_str(), count * sizeof(trajectory_record_t));
+    }
+
+    uint64_t total_records() const {
+        uint64_t total = 0;
+        for(tid_t t = 0; t < nthreads; t++) total += nrecords[t] + bufs[t].size();
+        return total;
+    }
+
+    /* merge all the records into the per walk paths, written to `output` and also `output`.txt if `text` */
+    void merge(const std::string &output, bool text) {
+        flush();
+
+        /* each run is a (file index, run) pair, the files are the trajectory files or the files of a merge pass */
+        std::vector<std::string> files;
+        std::vector<std::pair<size_t, trajectory_run_t>> all_runs;
+        wid_t max_id = 0;
+        for(tid_t t = 0; t < nthreads; t++) {
+            files.push_back(get_trajectory_name(base_name, blocksize, t));
+            for(const auto &run : runs[t]) {
+                all_runs.push_back(std::make_pair((size_t)t, run));
+                max_id = std::max(max_id, run.last);
+            }
+        }
+        int npasses = reduce_runs(output, files, all_runs);
+
+        /* split the walk id space, cuts[r][p] is the first record of run r that belongs to part p */
+        tid_t nparts = nthreads;
+        std::vector<uint64_t> bounds(nparts + 1);
+        for(tid_t p = 0; p <= nparts; p++) bounds[p] = (static_cast<uint64_t>(max_id) + 1) * p / nparts;
+        std::vector<std::vector<uint64_t>> cuts(all_runs.size(), std::vector<uint64_t>(nparts + 1));
+        #pragma omp parallel for schedule(dynamic) num_threads(nthreads)
+        for(size_t r = 0; r < all_runs.size(); r++) {
+            int fd = open(files[all_runs[r].first].c_str(), O_RDONLY);
+            for(tid_t p = 0; p <= nparts; p++) cuts[r][p] = lower_bound(fd, all_runs[r].second, bounds[p]);
+            close(fd);
+        }
+
+        std::vector<uint64_t> part_walks(nparts, 0), part_bytes(nparts, 0), part_text(nparts, 0);
+        #pragma omp parallel for schedule(dynamic, 1) num_threads(nthreads)
+        for(tid_t p = 0; p < nparts; p++) {
+            merge_part(p, files, all_runs, cuts, output, text, part_walks[p], part_bytes[p], part_text[p]);
+        }
+        if(npasses > 0) for(const auto &name : files) unlink(name.c_str());
+
+        trajectory_header_t header = { TRAJECTORY_MAGIC, 0, total_records() };
+        for(tid_t p = 0; p < nparts; p++) header.nwalks += part_walks[p];
+        int fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        assert(fd >= 0);
+        dump_block_range(fd, &header, 1, 0);
+        close(fd);
+        concat_parts(output, sizeof(trajectory_header_t), part_bytes);
+        if(text) concat_parts(output + ".txt", 0, part_text);
+
+        logstream(LOG_INFO) << "write " << header.nwalks << " walk paths, " << header.nsteps << " vertices into " << output << std::endl;
+    }
+
+private:
+    /* stable LSD radix sort of the records by walk id, the passes over the common digits are skipped */
+    static void radix_sort(std::vector<trajectory_record_t> &buf, std::vector<trajectory_record_t> &tmp) {
+        const int radix_bits = 11;
+        const size_t nbuckets = 1 << radix_bits;
+        wid_t diff = 0;
+        for(size_t i = 1; i < buf.size(); i++) diff |= buf[i].id ^ buf[0].id;
+        if(diff == 0) return;
+
+        tmp.resize(buf.size());
+        std::vector<size_t> counts(nbuckets);
+        for(int shift = 0; shift < static_cast<int>(sizeof(wid_t) * 8); shift += radix_bits) {
+            if(((diff >> shift) & (nbuckets - 1)) == 0) continue;
+            std::fill(counts.begin(), counts.end(), 0);
+            for(const auto &rec : buf) counts[(rec.id >> shift) & (nbuckets - 1)]++;
+            size_t sum = 0;
+            for(size_t b = 0; b < nbuckets; b++) {
+                size_t cnt = counts[b];
+                counts[b] = sum;
+                sum += cnt;
+            }
+            for(const auto &rec : buf) tmp[counts[(rec.id >> shift) & (nbuckets - 1)]++] = rec;
+            buf.swap(tmp);
+        }
+    }
+
+    /* the index of the first record in `run` whose walk id is not less than `id` */
+    uint64_t lower_bound(int fd, const trajectory_run_t &run, uint64_t id) {
+        if(id <= run.first) return run.off;
+        if(id > run.last) return run.off + run.count;
+        uint64_t lo = run.off, hi = run.off + run.count;
+        while(lo < hi) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            trajectory_record_t rec;
+            load_block_range(fd, &rec, 1, mid * sizeof(trajectory_record_t));
+            if(rec.id < id) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    static std::string part_name(const std::string &output, tid_t p) {
+        return output + ".part" + std::to_string(p);
+    }
+
+    static void write_vertex(std::vector<char> &out, vid_t v, char sep) {
+        char digits[16];
+        int len = 0;
+        do {
+            digits[len++] = '0' + v % 10;
+            v /= 10;
+        } while(v);
+        while(len > 0) out.push_back(digits[--len]);
+        out.push_back(sep);
+    }
+
+    static void flush_output(int fd, std::vector<char> &out, uint64_t &off) {
+        if(out.empty()) return;
+        dump_block_range(fd, out.data(), out.size(), off);
+        off += out.size();
+        out.clear();
+    }
+
+    void merge_part(tid_t p, const std::vector<std::string> &files, const std::vector<std::pair<size_t, trajectory_run_t>> &all_runs,
+                    const std::vector<std::vector<uint64_t>> &cuts, const std::string &output, bool text, uint64_t &nwalks, uint64_t &nbytes, uint64_t &ntext) {
+        std::vector<int> fds(files.size());
+        for(size_t f = 0; f < files.size(); f++) fds[f] = open(files[f].c_str(), O_RDONLY);
+
+        size_t nactive = 0;
+        for(size_t r = 0; r < all_runs.size(); r++) if(cuts[r][p + 1] > cuts[r][p]) nactive++;
+        size_t cursor_records = std::max<size_t>(1024, TRAJECTORY_MERGE_BUFFER / sizeof(trajectory_record_t) / std::max<size_t>(nactive, 1));
+
+        std::vector<trajectory_cursor_t> cursors;
+        cursors.reserve(nactive);
+        for(size_t r = 0; r < all_runs.size(); r++) {
+            if(cuts[r][p + 1] == cuts[r][p]) continue;
+            uint64_t cnt = std::min<uint64_t>(cursor_records, cuts[r][p + 1] - cuts[r][p]);
+            cursors.emplace_back(fds[all_runs[r].first], cuts[r][p], cuts[r][p + 1], cnt);
+        }
+
+        auto greater = [&cursors](size_t u, size_t v) { return trajectory_less(cursors[v].top(), cursors[u].top()); };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+        for(size_t c = 0; c < cursors.size(); c++) heap.push(c);
+
+        int bin_fd = open(part_name(output, p).c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+        int text_fd = text ? open(part_name(output + ".txt", p).c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR) : -1;
+        std::vector<char> bin_out, text_out;
+        bin_out.reserve(TRAJECTORY_WRITE_BUFFER + 1024);
+        if(text) text_out.reserve(TRAJECTORY_WRITE_BUFFER + 1024);
+        std::vector<vid_t> path;
+        wid_t walk_id = 0;
+        nwalks = nbytes = ntext = 0;
+
+        auto emit_path = [&]() {
+            if(path.empty()) return;
+            uint32_t len = path.size();
+            const char *head = reinterpret_cast<const char *>(&walk_id);
+            bin_out.insert(bin_out.end(), head, head + sizeof(wid_t));
+            head = reinterpret_cast<const char *>(&len);
+            bin_out.insert(bin_out.end(), head, head + sizeof(uint32_t));
+            head = reinterpret_cast<const char *>(path.data());
+            bin_out.insert(bin_out.end(), head, head + len * sizeof(vid_t));
+            if(bin_out.size() >= TRAJECTORY_WRITE_BUFFER) flush_output(bin_fd, bin_out, nbytes);
+            if(text) {
+                for(uint32_t i = 0; i < len; i++) write_vertex(text_out, path[i], i + 1 == len ? '\n' : ' ');
+                if(text_out.size() >= TRAJECTORY_WRITE_BUFFER) flush_output(text_fd, text_out, ntext);
+            }
+            nwalks++;
+            path.clear();
+        };
+
+        /* the steps of a walk are mostly contiguous in one run, take them until the next run goes first */
+        while(!heap.empty()) {
+            size_t c = heap.top();
+            heap.pop();
+            trajectory_record_t next = { ~static_cast<wid_t>(0), ~0U, 0 };
+            if(!heap.empty()) next = cursors[heap.top()].top();
+            do {
+                const trajectory_record_t &rec = cursors[c].top();
+                if(rec.id != walk_id) {
+                    emit_path();
+                    walk_id = rec.id;
+                }
+                path.push_back(rec.vertex);
+                cursors[c].pop();
+            } while(!cursors[c].empty() && !trajectory_less(next, cursors[c].top()));
+            if(!cursors[c].empty()) heap.push(c);
+        }
+        emit_path();
+        flush_output(bin_fd, bin_out, nbytes);
+        if(text) flush_output(text_fd, text_out, ntext);
+
+        close(bin_fd);
+        if(text_fd >= 0) close(text_fd);
+        for(int fd : fds) if(fd >= 0) close(fd);
+    }
+
+    /**
+     * merge the runs in groups of `TRAJECTORY_MAX_FANIN` into one run each, written to a file of the pass, until
+     * at most `TRAJECTORY_MAX_FANIN` runs are left. `files` and `all_runs` are replaced by the runs of the last
+     * pass, the files of the earlier passes are removed. return the number of passes.
+     */
+    int reduce_runs(const std::string &output, std::vector<std::string> &files, std::vector<std::pair<size_t, trajectory_run_t>> &all_runs) {
+        int pass = 0;
+        for(; all_runs.size() > TRAJECTORY_MAX_FANIN; pass++) {
+            size_t ngroups = (all_runs.size() + TRAJECTORY_MAX_FANIN - 1) / TRAJECTORY_MAX_FANIN;
+            std::vector<std::string> pass_files(ngroups);
+            std::vector<std::pair<size_t, trajectory_run_t>> pass_runs(ngroups);
+            #pragma omp parallel for schedule(dynamic, 1) num_threads(nthreads)
+            for(size_t g = 0; g < ngroups; g++) {
+                size_t first = g * TRAJECTORY_MAX_FANIN, last = std::min(all_runs.size(), first + TRAJECTORY_MAX_FANIN);
+                pass_files[g] = output + ".pass" + std::to_string(pass) + "." + std::to_string(g);
+                pass_runs[g] = std::make_pair(g, merge_runs(files, all_runs, first, last, pass_files[g]));
+            }
+            if(pass > 0) for(const auto &name : files) unlink(name.c_str());
+            files.swap(pass_files);
+            all_runs.swap(pass_runs);
+        }
+        if(pass > 0) logstream(LOG_DEBUG) << "merge the trajectory runs in " << pass << " passes, " << all_runs.size() << " runs left" << std::endl;
+        return pass;
+    }
+
+    /* merge the records of the runs [first, last) of `all_runs` into one run in the new file `name` */
+    trajectory_run_t merge_runs(const std::vector<std::string> &files, const std::vector<std::pair<size_t, trajectory_run_t>> &all_runs,
+                                size_t first, size_t last, const std::string &name) {
+        size_t cursor_records = std::max<size_t>(1024, TRAJECTORY_MERGE_BUFFER / sizeof(trajectory_record_t) / (last - first));
+        std::vector<int> fds;
+        std::vector<trajectory_cursor_t> cursors;
+        cursors.reserve(last - first);
+        for(size_t r = first; r < last; r++) {
+            const trajectory_run_t &run = all_runs[r].second;
+            if(run.count == 0) continue;
+            fds.push_back(open(files[all_runs[r].first].c_str(), O_RDONLY));
+            cursors.emplace_back(fds.back(), run.off, run.off + run.count, std::min<uint64_t>(cursor_records, run.count));
+        }
+
+        auto greater = [&cursors](size_t u, size_t v) { return trajectory_less(cursors[v].top(), cursors[u].top()); };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+        for(size_t c = 0; c < cursors.size(); c++) heap.push(c);
+
+        int out_fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+        assert(out_fd >= 0);
+        std::vector<trajectory_record_t> out;
+        out.reserve(TRAJECTORY_WRITE_BUFFER / sizeof(trajectory_record_t));
+        trajectory_run_t merged = { 0, 0, 0, 0 };
+        while(!heap.empty()) {
+            size_t c = heap.top();
+            heap.pop();
+            if(merged.count == 0 && out.empty()) merged.first = cursors[c].top().id;
+            merged.last = cursors[c].top().id;
+            out.push_back(cursors[c].top());
+            cursors[c].pop();
+            if(!cursors[c].empty()) heap.push(c);
+            if(out.size() == out.capacity()) {
+                dump_block_range(out_fd, out.data(), out.size(), merged.count * sizeof(trajectory_record_t));
+                merged.count += out.size();
+                out.clear();
+            }
+        }
+        dump_block_range(out_fd, out.data(), out.size(), merged.count * sizeof(trajectory_record_t));
+        merged.count += out.size();
+        close(out_fd);
+        for(int fd : fds) if(fd >= 0) close(fd);
+        return merged;
+    }
+
+    /* copy the part files into `output` after `offset` in parallel, and remove them */
+    void concat_parts(const std::string &output, uint64_t offset, const std::vector<uint64_t> &part_bytes) {
+        tid_t nparts = part_bytes.size();
+        std::vector<uint64_t> offs(nparts + 1, offset);
+        for(tid_t p = 0; p < nparts; p++) offs[p + 1] = offs[p] + part_bytes[p];
+
+        int fd = open(output.c_str(), O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        assert(fd >= 0);
+        ftruncate(fd, offs[nparts]);
+        #pragma omp parallel for schedule(dynamic, 1) num_threads(nthreads)
+        for(tid_t p = 0; p < nparts; p++) {
+            std::string name = part_name(output, p);
+            int part_fd = open(name.c_str(), O_RDONLY);
+            std::vector<char> buf(std::min<uint64_t>(TRAJECTORY_WRITE_BUFFER, std::max<uint64_t>(part_bytes[p], 1)));
+            for(uint64_t pos = 0; pos < part_bytes[p]; pos += buf.size()) {
+                size_t cnt = std::min<uint64_t>(buf.size(), part_bytes[p] - pos);
+                load_block_range(part_fd, buf.data(), cnt, pos);
+                dump_block_range(fd, buf.data(), cnt, offs[p] + pos);
+            }
+            close(part_fd);
+            unlink(name.c_str());
+        }
+        close(fd);
+    }
+};
+
+#endif
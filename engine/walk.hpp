@@ -2,10 +2,23 @@
 #define _GRAPH_WALK_H_
 
 #include <algorithm>
+#include <unordered_map>
 #include "api/types.hpp"
 #include "api/graph_buffer.hpp"
 #include "util/hash.hpp"
+#include "util/compress.hpp"
 #include "cache.hpp"
+#include "trajectory.hpp"
+#include "stream.hpp"
+#include "storage.hpp"
+#include "bucket.hpp"
+#include "source.hpp"
+#include "batch.hpp"
+#include "util/aligned.hpp"
+#include "util/radixsort.hpp"
+
+/* the batch order of the walks, see `graph_walk::sort_walks` */
+enum walk_order_t { ORDER_NONE, ORDER_VERTEX, ORDER_PAIR };
 
 class block_desc_manager_t {
 private:
@@ -20,6 +33,38 @@ public:
     int get_desc() const { return desc; }
 };
 
+#define WALK_STAGE_WALKS 1024    /* the walks a thread stages before moving them into the buckets */
+#define HOP_BINS 8                /* the bins of the remaining steps histogram of a block pair */
+
+/* the unpublished changes of the walk counts of one block pair by one thread */
+struct pair_delta_t {
+    wid_t dmem, ddisk;                  /* the changes of the memory and disk walks */
+    wid_t dhops[HOP_BINS];              /* the changes of the remaining steps histogram */
+};
+
+/**
+ * the memory walks and the unpublished walk count changes of one thread, the only state of the walk manager a
+ * thread writes while walking, padded and allocated on cache lines so no two threads share a line
+ */
+struct alignas(CACHE_LINE_SIZE) thread_walks_t {
+    typedef std::unordered_map<bid_t, walk_bucket, std::hash<bid_t>, std::equal_to<bid_t>, cache_line_allocator<std::pair<const bid_t, walk_bucket>>> bucket_map_t;
+    bucket_map_t buckets;                                                   /* the memory walks of the block pairs the thread holds walks of, a spilled or loaded bucket is erased */
+    std::vector<uint32_t, cache_line_allocator<uint32_t>> dirty_slot;       /* the index + 1 of the block pair in `dirty`, 0 if the pair has no change */
+    std::vector<bid_t, cache_line_allocator<bid_t>> dirty;                  /* the block pairs with changes */
+    std::vector<pair_delta_t, cache_line_allocator<pair_delta_t>> deltas;   /* the changes of each pair of `dirty` */
+    std::vector<walker_t, cache_line_allocator<walker_t>> staged, grouped;  /* the moved walks not in the buckets yet, and grouped by block pair */
+    std::vector<bid_t, cache_line_allocator<bid_t>> staged_pairs;           /* the block pair of each staged walk */
+    std::vector<wid_t, cache_line_allocator<wid_t>> pair_offs;              /* the staged walks of each block pair, then their offset in `grouped` */
+    std::vector<bid_t, cache_line_allocator<bid_t>> touched, full;          /* the block pairs of the staged walks, the buckets over `max_twalks` */
+
+    /* the bucket of the pair `blk`, NULL if the thread holds no walk of the pair */
+    walk_bucket *find(bid_t blk)
+    {
+        bucket_map_t::iterator it = buckets.find(blk);
+        return it == buckets.end() ? NULL : &it->second;
+    }
+};
+
 class graph_walk {
 public:
     std::string base_name;  /* the dataset base name, indicate the walks store path */
@@ -28,13 +73,34 @@ public:
     bid_t nblocks, totblocks;
     tid_t nthreads;
     graph_driver *global_driver;
-    std::vector<hid_t> maxhops;                         /* record the block has at least `maxhops` to finished */
+    hid_t hops;                                         /* the steps of a walk, set by the engine */
+    std::vector<wid_t> pair_hops;                       /* the walks of each block pair by their remaining steps, `HOP_BINS` bins per pair */
     graph_buffer<walker_t> walks;          /* the walks in current block */
-    graph_buffer<walker_t> **block_walks;  /* the walk resident in memroy */
-    std::vector<std::vector<wid_t>> block_nmwalk;       /* record each block number of walks in memroy */
-    std::vector<std::vector<wid_t>> block_ndwalk;       /* record each block number of walks in disk */
+    graph_buffer<walker_t> sort_buf;                    /* the scratch of reordering `walks` */
+    walk_order_t order;                                 /* the order of the walks in a batch */
+    size_t sort_min, sorted_batches;                    /* the batches of fewer walks are not reordered, the batches reordered */
+    walk_pool pool;                                     /* the chunks of the memory walk buckets */
+    size_t max_twalks;                                  /* the memory walks of a thread in one block pair before they are spilled */
+    std::vector<thread_walks_t, cache_line_allocator<thread_walks_t>> thread_walks; /* the walk resident in memroy */
+    bool spill_largest;                                 /* spill the largest bucket of the thread when the pool is exhausted */
+    size_t pool_spills;                                 /* the buckets spilled because the pool is exhausted */
+    std::vector<wid_t> pair_walks;                      /* the walks of each block pair, published by `publish` */
+    std::vector<wid_t> pair_mwalks, pair_dwalks;        /* the memory and the disk walks of each block pair */
+    wid_t total_walks;
+    std::vector<off_t> block_doff;                      /* the offset of the first unread walk in each walk file */
     graph_block *global_blocks;
 
+    bool compress;                                      /* spill walks in the compressed format */
+    std::vector<std::vector<uint8_t>> spill_bufs;       /* per thread buffer of the spilled bucket, grown on demand */
+    std::vector<std::vector<uint32_t>> spill_scratch;   /* per thread column buffer for encoding */
+    size_t spill_walks, spill_bytes;                    /* the number of spilled walks and bytes written */
+    bool keep_consumed;                                 /* keep the read walks in the walk files until the next checkpoint */
+    bool resumed;                                       /* the walk files are kept to resume from the checkpoint */
+    graph_trajectory *trajectory;                       /* record the walk paths, NULL if no output */
+    graph_stream *stream;                               /* stream the walk steps to a consumer, NULL if no streaming */
+    walk_source *source;                                /* the lazy start walks, NULL if the walks are moved in at the prologue */
+    graph_storage storage;                              /* the placement of the walk files */
+
     // BloomFilter *bf;
     graph_walk(graph_config& conf, graph_driver& driver, graph_block &blocks) {
         base_name = conf.base_name;
@@ -44,114 +110,396 @@ public:
         global_driver = &driver;
         global_blocks = &blocks;
         nblocks = global_blocks->nblocks;
+        storage.setup(conf);
+        huge_allocator.mode = conf.hugepage;
+        compress = conf.compress_walks;
+        spill_walks = spill_bytes = 0;
+        keep_consumed = conf.checkpoint > 0;
+        resumed = conf.resume && test_exists(get_checkpoint_name(base_name, blocksize));
+        trajectory = NULL;
+        if (!conf.trajectory.empty()) trajectory = new graph_trajectory(base_name, blocksize, nthreads, resumed);
+        stream = NULL;
+        if (!conf.stream.empty()) stream = new graph_stream(conf.stream, nthreads, conf.stream_fifo);
+        source = NULL;
 
         totblocks = nblocks * nblocks;
-        maxhops.resize(totblocks, 0);
-        walks.alloc(conf.max_nthreads * MAX_TWALKS * 5);
+        hops = 0;
+        pair_hops.resize(totblocks * HOP_BINS, 0);
+        walks.alloc(max_batch_walks(conf));
+        order = ORDER_NONE;
+        if (conf.walk_order == "vertex") order = ORDER_VERTEX;
+        else if (conf.walk_order == "pair") order = ORDER_PAIR;
+        else if (!conf.walk_order.empty()) logstream(LOG_WARNING) << "unknown walk order " << conf.walk_order << ", keep the load order" << std::endl;
+        if (order != ORDER_NONE) sort_buf.alloc(max_batch_walks(conf));
+        sort_min = conf.sort_min;
+        sorted_batches = 0;
+
+        pair_walks.resize(totblocks, 0);
+        pair_mwalks.resize(totblocks, 0);
+        pair_dwalks.resize(totblocks, 0);
+        total_walks = 0;
+        block_doff.resize(totblocks, 0);
+
+        /* the buckets are created by the first walk of their pair and take their chunks on demand */
+        thread_walks.resize(nthreads);
+        for (tid_t t = 0; t < nthreads; t++)
+        {
+            thread_walks[t].dirty_slot.resize(totblocks, 0);
+            thread_walks[t].staged.reserve(WALK_STAGE_WALKS);
+            thread_walks[t].grouped.resize(WALK_STAGE_WALKS);
+            thread_walks[t].staged_pairs.resize(WALK_STAGE_WALKS);
+            thread_walks[t].pair_offs.resize(totblocks, 0);
+        }
+        pool.setup(conf.walk_memory);
+        max_twalks = conf.thread_walks;
+        pool_spills = 0;
+        spill_largest = conf.spill_policy != "current";
+        if (conf.spill_policy != "largest" && conf.spill_policy != "current") logstream(LOG_WARNING) << "unknown spill policy " << conf.spill_policy << ", use largest" << std::endl;
 
-        block_nmwalk.resize(totblocks);
-        for (bid_t blk = 0; blk < totblocks; blk++)
+        spill_bufs.resize(nthreads);
+        if (compress) spill_scratch.resize(nthreads, std::vector<uint32_t>(WALK_CHUNK_WALKS));
+
+        for (bid_t blk = 0; blk < totblocks && !resumed; blk++)
         {
-            block_nmwalk[blk].resize(nthreads);
-            std::fill(block_nmwalk[blk].begin(), block_nmwalk[blk].end(), 0);
+            std::string name = walk_name(blk);
+            if(test_exists(name)) unlink(name.c_str());
         }
 
-        block_ndwalk.resize(totblocks);
+    }
+
+    ~graph_walk()
+    {
         for (bid_t blk = 0; blk < totblocks; blk++)
         {
-            block_ndwalk[blk].resize(nthreads);
-            std::fill(block_ndwalk[blk].begin(), block_ndwalk[blk].end(), 0);
+            std::string name = walk_name(blk);
+            if(test_exists(name)) unlink(name.c_str());
         }
+        walks.destroy();
+        if(trajectory) delete trajectory;
+        if(stream) delete stream;
 
-        block_walks = (graph_buffer<walker_t> **)malloc(totblocks * sizeof(graph_buffer<walker_t> *));
-        for (bid_t blk = 0; blk < totblocks; blk++)
+        // if(bf) delete bf;
+    }
+
+    /* stage the walk moving into the block pair of its blocks, the staged walks are moved into the buckets in bulk */
+    void move_walk(const walker_t &walker)
+    {
+        tid_t t = static_cast<tid_t>(omp_get_thread_num());
+        thread_walks_t &local = thread_walks[t];
+        local.staged.push_back(walker);
+        if(local.staged.size() == WALK_STAGE_WALKS) {
+            flush_staged(t);
+        }
+    }
+
+    /**
+     * move the staged walks of thread `t` into the buckets, grouped by block pair with a counting sort, so each
+     * pair takes one bulk append and one count change. the buckets over `max_twalks` are spilled by `spill_full`
+     * at the end of the batch, only the pool exhaustion spills a bucket here.
+     */
+    void flush_staged(tid_t t)
+    {
+        thread_walks_t &local = thread_walks[t];
+        size_t nstaged = local.staged.size();
+        if (nstaged == 0) return;
+        for (size_t i = 0; i < nstaged; i++)
+        {
+            bid_t blk = WALKER_PREV_BLOCK(local.staged[i]) * nblocks + WALKER_CUR_BLOCK(local.staged[i]);
+            local.staged_pairs[i] = blk;
+            if (local.pair_offs[blk]++ == 0) local.touched.push_back(blk);
+        }
+        wid_t off = 0;
+        for (bid_t blk : local.touched)
+        {
+            wid_t cnt = local.pair_offs[blk];
+            local.pair_offs[blk] = off;
+            off += cnt;
+        }
+        for (size_t i = 0; i < nstaged; i++)
+        {
+            local.grouped[local.pair_offs[local.staged_pairs[i]]++] = local.staged[i];
+            pair_delta(local, local.staged_pairs[i]).dhops[hop_bin(WALKER_HOP(local.staged[i]))]++;
+        }
+
+        /* the offsets have moved to the end of each group */
+        off = 0;
+        for (bid_t blk : local.touched)
+        {
+            wid_t end = local.pair_offs[blk];
+            append_walks(blk, t, local.grouped.data() + off, end - off);
+            local.pair_offs[blk] = 0;
+            off = end;
+            if (local.find(blk)->size() >= max_twalks) local.full.push_back(blk);
+        }
+        local.touched.clear();
+        local.staged.clear();
+    }
+
+    /* append `n` walks to the bucket of `blk` of thread `t`, spill the buckets of the thread while the pool is exhausted */
+    void append_walks(bid_t blk, tid_t t, const walker_t *walkers, size_t n)
+    {
+        thread_walks_t::bucket_map_t &buckets = thread_walks[t].buckets;
+        size_t done = 0;
+        /* the spill of a victim erases its bucket, so the bucket of `blk` is looked up again after each spill */
+        while ((done += buckets[blk].append(walkers + done, n - done, pool)) < n)
         {
-            block_walks[blk] = (graph_buffer<walker_t> *)malloc(nthreads * sizeof(graph_buffer<walker_t>));
-            for (tid_t tid = 0; tid < nthreads; tid++)
+            bid_t victim = spill_victim(blk, t);
+            /* a thread without chunks takes one over the cap */
+            if (victim == totblocks)
             {
-                block_walks[blk][tid].alloc(MAX_TWALKS);
+                done += buckets[blk].append(walkers + done, 1, pool, true);
+                continue;
             }
+            persistent_walks(victim, t);
+            __sync_fetch_and_add(&pool_spills, 1);
         }
+        change_walks(t, blk, n, 0);
+    }
 
-        for (bid_t blk = 0; blk < totblocks; blk++)
+    /* spill the buckets of thread `t` that have reached `max_twalks` */
+    void spill_full(tid_t t)
+    {
+        thread_walks_t &local = thread_walks[t];
+        for (bid_t blk : local.full)
         {
-            std::string walk_name = get_walk_name(base_name, blocksize, blk);
-            if(test_exists(walk_name)) unlink(walk_name.c_str());
+            walk_bucket *bucket = local.find(blk);
+            if (bucket && bucket->size() >= max_twalks) persistent_walks(blk, t);
         }
+        local.full.clear();
+    }
 
+    /* the unpublished changes of `blk` in `local`, the pair joins the dirty list at its first change */
+    pair_delta_t &pair_delta(thread_walks_t &local, bid_t blk)
+    {
+        if (local.dirty_slot[blk] == 0)
+        {
+            local.dirty.push_back(blk);
+            local.deltas.push_back(pair_delta_t());
+            local.dirty_slot[blk] = local.dirty.size();
+        }
+        return local.deltas[local.dirty_slot[blk] - 1];
     }
 
-    ~graph_walk()
+    /* record the change of the memory and disk walks of `blk` by thread `t`, published by `publish` */
+    void change_walks(tid_t t, bid_t blk, wid_t dmem, wid_t ddisk)
     {
-        for (bid_t blk = 0; blk < totblocks; blk++)
+        pair_delta_t &delta = pair_delta(thread_walks[t], blk);
+        delta.dmem += dmem;
+        delta.ddisk += ddisk;
+    }
+
+    /* update the walk counts of `blk` from a single thread, may run along with the disk walk reader */
+    void add_walks(bid_t blk, wid_t dmem, wid_t ddisk)
+    {
+        if (dmem == 0 && ddisk == 0) return;
+        __sync_fetch_and_add(&pair_mwalks[blk], dmem);
+        __sync_fetch_and_add(&pair_dwalks[blk], ddisk);
+        __sync_fetch_and_add(&pair_walks[blk], dmem + ddisk);
+        __sync_fetch_and_add(&total_walks, dmem + ddisk);
+    }
+
+    /**
+     * move the staged walks of the threads into the buckets and spill the full buckets, then fold the walk count
+     * changes of the threads into the block pair counts, called after the walks are moved in parallel, the counts
+     * are read in O(1) until the next parallel move. the changes are unsigned and wrap around, a decrease is the
+     * addition of its two's complement.
+     */
+    void publish()
+    {
+        #pragma omp parallel for schedule(static, 1)
+        for (tid_t t = 0; t < nthreads; t++)
         {
-            for (tid_t tid = 0; tid < nthreads; tid++)
+            flush_staged(t);
+            spill_full(t);
+        }
+        for (tid_t t = 0; t < nthreads; t++)
+        {
+            thread_walks_t &local = thread_walks[t];
+            for (size_t i = 0; i < local.dirty.size(); i++)
             {
-                block_walks[blk][tid].destroy();
+                bid_t blk = local.dirty[i];
+                const pair_delta_t &delta = local.deltas[i];
+                add_walks(blk, delta.dmem, delta.ddisk);
+                for (unsigned b = 0; b < HOP_BINS; b++)
+                {
+                    if (delta.dhops[b] != 0) __sync_fetch_and_add(&pair_hops[blk * HOP_BINS + b], delta.dhops[b]);
+                }
+                local.dirty_slot[blk] = 0;
             }
-            free(block_walks[blk]);
+            local.dirty.clear();
+            local.deltas.clear();
         }
-        free(block_walks);
+    }
 
-        for (bid_t blk = 0; blk < totblocks; blk++)
+    /**
+     * generate the start walks of `src` lazily, the pending start walks of each block are counted in the walks of
+     * the pair (blk, blk). when resuming, the progress and the counts are restored from the checkpoint instead.
+     */
+    void set_source(walk_source *src)
+    {
+        source = src;
+        source->setup(*global_blocks);
+        for (bid_t blk = 0; blk < nblocks && !resumed; blk++)
         {
-            std::string walk_name = get_walk_name(base_name, blocksize, blk);
-            if(test_exists(walk_name)) unlink(walk_name.c_str());
+            add_source_walks(blk * nblocks + blk, source->count(blk));
         }
-        walks.destroy();
+    }
 
-        // if(bf) delete bf;
+    /* count `nwalks` pending start walks in the pair `blk`, their steps are all remaining */
+    void add_source_walks(bid_t blk, wid_t nwalks)
+    {
+        __sync_fetch_and_add(&pair_walks[blk], nwalks);
+        __sync_fetch_and_add(&total_walks, nwalks);
+        __sync_fetch_and_add(&pair_hops[blk * HOP_BINS + hop_bin(0)], nwalks);
     }
 
-    void move_walk(const walker_t &walker)
+    /* the histogram bin of the walks at `hop`, by the steps left */
+    unsigned hop_bin(hid_t hop) const
     {
-        tid_t t = static_cast<vid_t>(omp_get_thread_num());
-        bid_t pblk = WALKER_PREV_BLOCK(walker), cblk = WALKER_CUR_BLOCK(walker);
-        bid_t blk = pblk * nblocks + cblk;
-        if(block_walks[blk][t].full()) {
-            persistent_walks(blk, t);
-        }
+        if (hop >= hops) return 0;
+        return (unsigned)(hops - hop - 1) * HOP_BINS / hops;
+    }
 
-        block_nmwalk[blk][t] += 1;
-        block_walks[blk][t].push_back(walker);
+    /* the fewest steps left of the walks in the bin `bin` */
+    hid_t bin_remaining(unsigned bin) const
+    {
+        return (bin * hops + HOP_BINS - 1) / HOP_BINS + 1;
     }
 
-    void persistent_walks(bid_t blk, tid_t t)
+    /* take the walks of `walkers` out of the histogram of `blk`, they are being walked */
+    void remove_hops(bid_t blk, const walker_t *walkers, size_t n)
     {
-        block_ndwalk[blk][t] += block_walks[blk][t].size();
-        block_nmwalk[blk][t] -= block_walks[blk][t].size();
-        appendfile(get_walk_name(base_name, blocksize, blk), block_walks[blk][t].buffer_begin(), block_walks[blk][t].size());
-        block_walks[blk][t].clear();
+        wid_t bins[HOP_BINS] = {0};
+        for (size_t i = 0; i < n; i++) bins[hop_bin(WALKER_HOP(walkers[i]))]++;
+        for (unsigned b = 0; b < HOP_BINS; b++)
+        {
+            if (bins[b] != 0) __sync_fetch_and_sub(&pair_hops[blk * HOP_BINS + b], bins[b]);
+        }
     }
 
-    wid_t nblockwalks(bid_t blk)
+    /* the most steps left of the walks in the pair `blk`, 0 if the pair has no walk */
+    hid_t max_remaining_hops(bid_t blk) const
     {
-        wid_t walksum = 0;
-        for (tid_t t = 0; t < nthreads; t++)
+        for (unsigned b = HOP_BINS; b > 0; b--)
         {
-            walksum += block_nmwalk[blk][t] + block_ndwalk[blk][t];
+            if (pair_hops[blk * HOP_BINS + b - 1] > 0) return std::min<hid_t>(((b * hops) + HOP_BINS - 1) / HOP_BINS, hops);
         }
-        return walksum;
+        return 0;
     }
 
-    wid_t nmwalks(bid_t exec_block)
+    /* the walks of the pair `blk` weighted by the inverse of their steps left, the pairs closest to finishing rank first */
+    real_t finish_score(bid_t blk) const
     {
-        wid_t walksum = 0;
-        for (tid_t t = 0; t < nthreads; t++)
+        real_t score = 0.0;
+        for (unsigned b = 0; b < HOP_BINS; b++) score += (real_t)pair_hops[blk * HOP_BINS + b] / bin_remaining(b);
+        return score;
+    }
+
+    /* the bucket of thread `t` to spill when the pool is exhausted while moving a walk into `blk`, `totblocks` if the thread holds no walk, only the pairs the thread holds walks of are scanned */
+    bid_t spill_victim(bid_t blk, tid_t t)
+    {
+        thread_walks_t &local = thread_walks[t];
+        walk_bucket *current = local.find(blk);
+        if(!spill_largest && current && !current->empty()) return blk;
+        bid_t victim = totblocks;
+        size_t most = 0;
+        for (const auto &entry : local.buckets)
         {
-            walksum += block_nmwalk[exec_block][t];
+            if (entry.second.size() > most)
+            {
+                victim = entry.first;
+                most = entry.second.size();
+            }
         }
-        return walksum;
+        return victim;
     }
 
-    wid_t ndwalks(bid_t exec_block)
+    std::string walk_name(bid_t blk) const
     {
-        wid_t walksum = 0;
-        for (tid_t t = 0; t < nthreads; t++)
+        return storage.walk_name(blk, blk / nblocks, blk % nblocks);
+    }
+
+    /* record the vertex of walk `id` at `hop` into the trajectory and the stream */
+    void record_step(wid_t id, hid_t hop, vid_t vertex)
+    {
+        if(!trajectory && !stream) return;
+        tid_t t = static_cast<tid_t>(omp_get_thread_num());
+        if(trajectory) trajectory->record(t, id, hop, vertex);
+        if(stream) stream->record(t, id, hop, vertex);
+    }
+
+    /* spill the bucket of `blk` of thread `t` chunk by chunk, return its chunks to the pool and erase it */
+    void persistent_walks(bid_t blk, tid_t t)
+    {
+        walk_bucket &bucket = thread_walks[t].buckets[blk];
+        size_t nwalks = bucket.size(), nbytes = 0;
+        change_walks(t, blk, -static_cast<wid_t>(nwalks), nwalks);
+
+        /* the chunks of the bucket are gathered into the spill buffer and appended to the walk file at once */
+        std::vector<uint8_t> &buf = spill_bufs[t];
+        size_t max_bytes = compress ? bucket.nchunks() * walk_chunk_max_bytes(WALK_CHUNK_WALKS) : nwalks * sizeof(walker_t);
+        if (buf.size() < max_bytes) buf.resize(max_bytes);
+        vid_t prev_start = (*global_blocks)[blk / nblocks].start_vert, cur_start = (*global_blocks)[blk % nblocks].start_vert;
+        for (size_t c = 0; c < bucket.nchunks(); c++)
         {
-            walksum += block_ndwalk[exec_block][t];
+            if (compress)
+            {
+                nbytes += encode_walk_chunk(bucket.chunk(c), bucket.chunk_size(c), prev_start, cur_start, spill_scratch[t].data(), buf.data() + nbytes);
+            }
+            else
+            {
+                memcpy(buf.data() + nbytes, bucket.chunk(c), bucket.chunk_size(c) * sizeof(walker_t));
+                nbytes += bucket.chunk_size(c) * sizeof(walker_t);
+            }
         }
-        return walksum;
+        if (nbytes > 0) appendfile(walk_name(blk), buf.data(), nbytes);
+        __sync_fetch_and_add(&spill_walks, nwalks);
+        __sync_fetch_and_add(&spill_bytes, nbytes);
+        bucket.clear(pool);
+        thread_walks[t].buckets.erase(blk);
+    }
+
+    wid_t nblockwalks(bid_t blk) const
+    {
+        return pair_walks[blk];
+    }
+
+    wid_t nmwalks(bid_t exec_block) const
+    {
+        return pair_mwalks[exec_block];
+    }
+
+    wid_t ndwalks(bid_t exec_block) const
+    {
+        return pair_dwalks[exec_block];
+    }
+
+    /* the start walks of the pair `exec_block` not generated yet */
+    wid_t nvwalks(bid_t exec_block) const
+    {
+        bid_t blk = exec_block % nblocks;
+        if (!source || exec_block / nblocks != blk) return 0;
+        return source->pending(blk);
+    }
+
+    /* the walks of all the block pairs, indexed by `prev_blk * nblocks + cur_blk` */
+    const std::vector<wid_t> &block_pair_walks() const
+    {
+        return pair_walks;
+    }
+
+    /* the memory walks of thread `t` in block pair `blk`, created if the thread holds no walk of the pair */
+    walk_bucket &bucket(bid_t blk, tid_t t)
+    {
+        return thread_walks[t].buckets[blk];
+    }
+
+    /* the memory walks of thread `t` in block pair `blk`, an empty bucket if the thread holds no walk of the pair */
+    const walk_bucket &find_bucket(bid_t blk, tid_t t) const
+    {
+        static const walk_bucket empty;
+        thread_walks_t::bucket_map_t::const_iterator it = thread_walks[t].buckets.find(blk);
+        return it == thread_walks[t].buckets.end() ? empty : it->second;
     }
 
     wid_t ncwalks(graph_cache *cache)
@@ -168,14 +516,9 @@ public:
         return walk_sum;
     }
 
-    wid_t nwalks()
+    wid_t nwalks() const
     {
-        wid_t walksum = 0;
-        for (bid_t blk = 0; blk < totblocks; blk++)
-        {
-            walksum += this->nblockwalks(blk);
-        }
-        return walksum;
+        return total_walks;
     }
 
     size_t load_memory_walks(bid_t exec_block) {
@@ -183,35 +526,101 @@ public:
         /* load in memory walks */
         for (tid_t t = 0; t < nthreads; t++)
         {
-            if (block_walks[exec_block][t].empty())
-                continue;
-            for (wid_t w = 0; w < block_walks[exec_block][t].size(); w++)
+            walk_bucket *bucket = thread_walks[t].find(exec_block);
+            if (bucket == NULL) continue;
+            for (size_t c = 0; c < bucket->nchunks(); c++)
             {
-                walks.push_back(block_walks[exec_block][t][w]);
+                assert(!walks.test_overflow(bucket->chunk_size(c)));
+                memcpy(walks.buffer_begin() + walks.size(), bucket->chunk(c), bucket->chunk_size(c) * sizeof(walker_t));
+                remove_hops(exec_block, bucket->chunk(c), bucket->chunk_size(c));
+                walks.set_size(walks.size() + bucket->chunk_size(c));
             }
         }
 
         /* clear memory walks */
-        std::fill(block_nmwalk[exec_block].begin(), block_nmwalk[exec_block].end(), 0);
+        add_walks(exec_block, -pair_mwalks[exec_block], 0);
         for (tid_t t = 0; t < nthreads; t++)
         {
-            block_walks[exec_block][t].clear();
+            walk_bucket *bucket = thread_walks[t].find(exec_block);
+            if (bucket == NULL) continue;
+            bucket->clear(pool);
+            thread_walks[t].buckets.erase(exec_block);
         }
         return 0;
     }
 
-    size_t load_disk_walks(bid_t exec_block, wid_t walk_cnt, wid_t loaded_walks) {
-        walks.clear();
-        block_desc_manager_t block_desc(get_walk_name(base_name, blocksize, exec_block));
-        global_driver->load_walk(block_desc.get_desc(), walk_cnt, loaded_walks, walks);
-        return walks.size();
+    /* generate at most `max_walks` pending start walks of the pair `exec_block` behind the walks in the buffer */
+    wid_t load_source_walks(bid_t exec_block, wid_t max_walks) {
+        if (nvwalks(exec_block) == 0) return 0;
+        wid_t nwalks = source->generate(exec_block % nblocks, max_walks, walks.buffer_begin() + walks.size());
+        walks.set_size(walks.size() + nwalks);
+        add_source_walks(exec_block, -nwalks);
+        return nwalks;
     }
 
-    void dump_walks(bid_t exec_block)
+    /**
+     * reorder the loaded walks by the current vertex, or by the previous block then the current vertex, so the
+     * walks read the adjacency lists of the blocks in order and the walks at the same vertex read it back to back.
+     * the batches of fewer than `sort_min` walks fit into the cpu cache anyway and keep the load order.
+     */
+    bool sort_walks()
     {
-        std::fill(block_ndwalk[exec_block].begin(), block_ndwalk[exec_block].end(), 0);
-        block_desc_manager_t block_desc(get_walk_name(base_name, blocksize, exec_block));
-        ftruncate(block_desc.get_desc(), 0);
+        size_t nwalks = walks.size();
+        if (order == ORDER_NONE || nwalks < sort_min) return false;
+        unsigned vertex_bits = walker_layout.vertex_bits;
+        bool swapped;
+        if (order == ORDER_VERTEX)
+        {
+            swapped = parallel_radix_sort(walks.buffer_begin(), sort_buf.buffer_begin(), nwalks, vertex_bits,
+                [](const walker_t &walker) { return (uint64_t)WALKER_POS(walker); });
+        }
+        else
+        {
+            swapped = parallel_radix_sort(walks.buffer_begin(), sort_buf.buffer_begin(), nwalks, vertex_bits + walker_layout_t::bit_width(nblocks - 1),
+                [vertex_bits](const walker_t &walker) { return (uint64_t)WALKER_PREV_BLOCK(walker) << vertex_bits | WALKER_POS(walker); });
+        }
+        if (swapped)
+        {
+            sort_buf.set_size(nwalks);
+            walks.swap(sort_buf);
+        }
+        sorted_batches++;
+        return true;
+    }
+
+    /* load at most `walk_cnt` disk walks of the opened walk file `fd` start from the offset `off` into `buf`, and move `off` to the next unread walk */
+    size_t load_disk_walks(bid_t exec_block, int fd, wid_t walk_cnt, off_t &off, graph_buffer<walker_t> &buf) {
+        buf.clear();
+        if (compress)
+        {
+            global_driver->load_walk(fd, walk_cnt, off, buf, (*global_blocks)[exec_block / nblocks], (*global_blocks)[exec_block % nblocks]);
+        }
+        else
+        {
+            global_driver->load_walk(fd, walk_cnt, off, buf);
+        }
+        remove_hops(exec_block, buf.buffer_begin(), buf.size());
+        return buf.size();
+    }
+
+    /**
+     * drop the `nread` disk walks of `exec_block` that have been read up to the offset `off`, called by the engine
+     * thread after their last batch has been updated. the walks spilled into the pair meanwhile stay after `off`,
+     * the file is only truncated if it holds no other walk and no checkpoint refers to it.
+     */
+    void dump_walks(bid_t exec_block, wid_t nread, off_t off)
+    {
+        add_walks(exec_block, 0, -nread);
+        if (!keep_consumed && pair_dwalks[exec_block] == 0)
+        {
+            block_desc_manager_t block_desc(walk_name(exec_block));
+            ftruncate(block_desc.get_desc(), 0);
+            block_doff[exec_block] = 0;
+        }
+        else
+        {
+            block_doff[exec_block] = off;
+        }
     }
 
     bool test_finished_walks()
@@ -246,9 +655,9 @@ public:
         bid_t blk = 0;
         for (bid_t p = 0; p < totblocks; p++)
         {
-            if (maxhops[p] > walk_hop)
+            if (max_remaining_hops(p) > walk_hop)
             {
-                walk_hop = maxhops[p];
+                walk_hop = max_remaining_hops(p);
                 blk = p;
             }
         }
@@ -266,6 +675,23 @@ public:
             return max_walks_block();
     }
 
+    /* the distinct vertices of block `blk` the memory walks step from next, the current vertices of the walks in (*, blk) and the previous vertices of the walks in (blk, *) */
+    void block_vertices(bid_t blk, std::vector<vid_t> &verts) {
+        verts.clear();
+        for (bid_t p = 0; p < nblocks; p++)
+        {
+            for (tid_t t = 0; t < nthreads; t++)
+            {
+                const walk_bucket &cur_walks = find_bucket(p * nblocks + blk, t);
+                for (wid_t w = 0; w < cur_walks.size(); w++) verts.push_back(WALKER_POS(cur_walks[w]));
+                const walk_bucket &prev_walks = find_bucket(blk * nblocks + p, t);
+                for (wid_t w = 0; w < prev_walks.size(); w++) verts.push_back(WALKER_PREVIOUS(prev_walks[w]));
+            }
+        }
+        std::sort(verts.begin(), verts.end());
+        verts.erase(std::unique(verts.begin(), verts.end()), verts.end());
+    }
+
     wid_t block_active_walks(bid_t blk) {
         wid_t walks_cnt = 0;
         for (bid_t p = 0; p < nblocks; p++)
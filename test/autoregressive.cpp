@@ -25,6 +25,34 @@ int main(int argc, const char *argv[])
     size_t blocksize = get_option_long("blocksize", BLOCK_SIZE);
     size_t nthreads = get_option_int("nthreads", omp_get_max_threads());
     size_t dynamic = get_option_bool("dynamic"); // the blocksize is dynamic, according to the number of walks
+    bool compress = get_option_bool("compress"); // spill walks in the compressed format
+    size_t checkpoint = get_option_int("checkpoint", 0); // take a checkpoint every `checkpoint` rounds
+    bool resume = get_option_bool("resume"); // continue from the last checkpoint
+    std::string trajectory = get_option_string("trajectory", ""); // the output file of the walk paths
+    bool text = get_option_bool("text"); // also write the walk paths in the text format
+    std::string stream = get_option_string("stream", ""); // stream the walk steps into the shared memory
+    bool streamfifo = get_option_bool("streamfifo"); // stream the walk steps into a named pipe instead
+    std::string roots = get_option_string("roots", ""); // the comma separated storage directories of the blocks and walks
+    std::string hugepage = get_option_string("hugepage", "none"); // none, thp or hugetlb pages for the cache blocks and walk buffers
+    real_t selective = (real_t)get_option_float("selective", 0.0); // load the blocks with few walks selectively, e.g. 0.1
+    std::string policy = get_option_string("policy", "lru"); // the cache replacement policy, lru, lfu, arc or belady
+    size_t hub = get_option_int("hub", 0); // the MB of the pinned adjacency cache of the hot vertices
+    std::string hubrank = get_option_string("hubrank", "degree"); // rank the hub vertices by degree or visits
+    bool blockmap = get_option_bool("blockmap"); // map the vertices to the blocks with a packed per vertex map
+    bool packed = get_option_bool("packed"); // keep the cache blocks bit packed in memory
+    size_t shared = get_option_int("shared", 0); // the MB of the block cache shared with the concurrent jobs on the dataset
+    std::string preload = get_option_string("preload", ""); // warm up the cache with the blocks of the last run (snapshot) or of the start walks (walks)
+    size_t walkmem = get_option_int("walkmem", 0); // the MB of the memory walk buckets, 0 means no cap
+    std::string spill = get_option_string("spill", "largest"); // the bucket to spill when the walk memory is exhausted, largest or current
+    std::string order = get_option_string("order", ""); // reorder the walk batches by vertex or by pair before walking
+    size_t sortmin = get_option_int("sortmin", WALK_SORT_MIN); // the walk batches of fewer walks keep the load order
+    size_t tail = get_option_int("tail", 0); // drain the last `tail` walks by their steps left with selective loads, 0 means never
+    size_t twalks = get_option_int("twalks", MAX_TWALKS); // the memory walks of a thread in one block pair before they are spilled
+    size_t bwalks = get_option_int("bwalks", MAX_BWALKS); // the walks of the largest batch per thread
+    std::string batch = get_option_string("batch", "adaptive"); // size the walk batches `adaptive`ly or keep them `fixed`
+    std::string sources = get_option_string("sources", ""); // the file of the start vertices, `walksource` sampled vertices by default
+    std::string sourcedist = get_option_string("sourcedist", "uniform"); // sample the start vertices uniformly or by degree
+    uint64_t seed = get_option_long("seed", DEFAULT_SEED); // the seed of the sampled start vertices
     size_t cache_size = get_option_int("cache", MEMORY_CACHE / (1024LL * 1024 * 1024));
     size_t max_iter = get_option_int("iter", 30);
     wid_t walks = (wid_t)get_option_int("walksource", 100000);
@@ -65,7 +93,32 @@ int main(int argc, const char *argv[])
         (tid_t)omp_get_max_threads(),
         nvertices,
         nedges,
-        weighted
+        weighted,
+        compress,
+        checkpoint,
+        resume,
+        trajectory,
+        text,
+        stream,
+        streamfifo,
+        roots,
+        parse_hugepage_mode(hugepage),
+        selective,
+        policy,
+        hub * 1024LL * 1024,
+        hubrank,
+        blockmap,
+        packed,
+        shared * 1024LL * 1024,
+        preload,
+        walkmem * 1024LL * 1024,
+        spill,
+        order,
+        sortmin,
+        tail,
+        twalks,
+        bwalks,
+        batch
     };
 
     graph_block blocks(&conf);
@@ -75,7 +128,7 @@ int main(int argc, const char *argv[])
     graph_driver driver(&conf, m);
 
     graph_walk walk_mangager(conf, driver, blocks);
-    graph_cache cache(min_value(nmblocks, blocks.nblocks), &conf);
+    graph_cache cache(min_value(nmblocks, blocks.nblocks), &conf, blocks);
     m.set("nblocks", std::to_string(blocks.nblocks));
     m.set("ncblocks", std::to_string(cache.ncblock));
 
@@ -84,24 +137,14 @@ int main(int argc, const char *argv[])
 
     lp_solver_scheduler_t walk_scheduler(m);
 
-    auto init_func = [walks, walkpersource](graph_walk *walk_manager)
-    {
-        #pragma omp parallel for schedule(static)
-        for(wid_t off = 0; off < walks; off++)
-        {
-            vid_t vertex = rand() % walk_manager->nvertices;
-            bid_t index = walk_manager->global_blocks->get_block(vertex);
-            for(wid_t cnt = 0; cnt < walkpersource; cnt++) {
-                wid_t walker_id = off * walkpersource + cnt;
-                walker_t walker = walker_makeup(walker_id, vertex, vertex, vertex, 0, index, index);
-                walk_manager->move_walk(walker);
-            }
-        }
-    };
+    /* the sampled start walks are generated block by block when the blocks are first scheduled */
+    logstream(LOG_INFO) << "the seed of the sampled start vertices : " << seed << std::endl;
+    walk_source *source = create_walk_source(conf, sources, walks, sourcedist, walkpersource, seed);
 
-    engine.prologue(userprogram, init_func);
+    engine.prologue(userprogram, source);
     engine.run(userprogram, &walk_scheduler);
     engine.epilogue(userprogram);
+    delete source;
 
     metrics_report(m);
 
@@ -0,0 +1,36 @@
+#include <chrono>
+#include "api/cmdopts.hpp"
+#include "engine/stream.hpp"
+#include "logger/logger.hpp"
+
+/**
+ * A consumer stub of the walk stream, it reads the walk steps published by `node2vec stream <name>`
+ * and reports the number of steps, walks and the throughput. A trainer reads the stream in the same way.
+ */
+int main(int argc, const char* argv[]) {
+    assert(argc >= 2);
+    set_argc(argc, argv);
+    std::string name = argv[1];
+    bool fifo = get_option_bool("fifo"); // read the named pipe instead of the shared memory
+
+    walk_stream_reader reader(name, fifo);
+    logstream(LOG_INFO) << "app : " << argv[0] << ", waiting for the stream " << name << std::endl;
+    reader.attach();
+    auto start = std::chrono::steady_clock::now();
+
+    size_t nsteps = 0, nwalks = 0;
+    const trajectory_record_t *recs = NULL;
+    uint32_t ring = 0;
+    size_t cnt = 0;
+    while((cnt = reader.next(recs, ring)) > 0) {
+        for(size_t i = 0; i < cnt; i++) {
+            if(recs[i].hop == 0) nwalks++;
+        }
+        nsteps += cnt;
+        reader.release(ring, cnt);
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    logstream(LOG_INFO) << "read " << nsteps << " steps of " << nwalks << " walks in " << elapsed << "s, " << nsteps / std::max(elapsed, 1e-9) << " steps/s" << std::endl;
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef _GRAPH_ALIGNED_H_
+#define _GRAPH_ALIGNED_H_
+
+#include <new>
+#include <cstddef>
+#include <cstdlib>
+
+/**
+ * This file defines the cache line aligned allocator of the per thread data, an allocation starts at a cache line
+ * and is rounded up to whole cache lines, so the data of two threads never share a cache line.
+ */
+
+#define CACHE_LINE_SIZE 64
+
+template<typename T>
+class cache_line_allocator {
+public:
+    typedef T value_type;
+
+    cache_line_allocator() { }
+    template<typename U> cache_line_allocator(const cache_line_allocator<U> &) { }
+
+    T *allocate(size_t n) {
+        void *ptr = NULL;
+        size_t bytes = (n * sizeof(T) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+        if(posix_memalign(&ptr, CACHE_LINE_SIZE, bytes) != 0) throw std::bad_alloc();
+        return static_cast<T *>(ptr);
+    }
+
+    void deallocate(T *ptr, size_t) { free(ptr); }
+};
+
+template<typename T, typename U>
+bool operator==(const cache_line_allocator<T> &, const cache_line_allocator<U> &) { return true; }
+
+template<typename T, typename U>
+bool operator!=(const cache_line_allocator<T> &, const cache_line_allocator<U> &) { return false; }
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef _GRAPH_BITPACK_H_
+#define _GRAPH_BITPACK_H_
+
+#include <cstring>
+#include <cstddef>
+#include <iterator>
+#include <algorithm>
+#include <stdint.h>
+#include "api/types.hpp"
+
+/**
+ * This file defines the bit packed adjacency format of the cache blocks kept compressed in memory.
+ *
+ * Each vertex has one record, addressed by a per vertex byte offset, the record is the degree in varint, then for a
+ * non empty list the frame of reference `base` (the minimum neighbor), the bit `width` of the largest `nbr - base`
+ * and the packed `nbr - base` values, `width` bits each:
+ *
+ * | deg (varint) | width (1 byte) | base (4 bytes) | (nbr[0] - base) ... (nbr[deg - 1] - base) |
+ *
+ * The neighbor order is kept, so `adj_list` decodes any position in O(1) for the rejection samplers and a sorted
+ * list still supports the binary search of the membership tests.
+ */
+
+#define BITPACK_PADDING 8   /* the decoder reads 8 bytes at the byte of a value */
+
+inline size_t varint_bytes(eid_t val) {
+    size_t n = 1;
+    while(val >= 0x80) { val >>= 7; n++; }
+    return n;
+}
+
+inline uint8_t bitpack_width(const vid_t *list, eid_t deg, vid_t &base) {
+    vid_t lo = list[0], hi = list[0];
+    for(eid_t i = 1; i < deg; i++) {
+        lo = std::min(lo, list[i]);
+        hi = std::max(hi, list[i]);
+    }
+    base = lo;
+    uint8_t width = 0;
+    while(width < 32 && ((uint64_t)(hi - lo) >> width) != 0) width++;
+    return width;
+}
+
+/** the bytes of the record of the list `list` with `deg` neighbors */
+inline size_t bitpack_record_bytes(const vid_t *list, eid_t deg) {
+    if(deg == 0) return varint_bytes(0);
+    vid_t base;
+    uint8_t width = bitpack_width(list, deg, base);
+    return varint_bytes(deg) + 1 + sizeof(vid_t) + (deg * width + 7) / 8;
+}
+
+/** encode the record of `list` into `out`, return the number of bytes written */
+inline size_t bitpack_encode(const vid_t *list, eid_t deg, uint8_t *out) {
+    uint8_t *ptr = out;
+    eid_t val = deg;
+    while(val >= 0x80) { *ptr++ = (uint8_t)(val | 0x80); val >>= 7; }
+    *ptr++ = (uint8_t)val;
+    if(deg == 0) return ptr - out;
+
+    vid_t base;
+    uint8_t width = bitpack_width(list, deg, base);
+    *ptr++ = width;
+    memcpy(ptr, &base, sizeof(vid_t));
+    ptr += sizeof(vid_t);
+
+    uint64_t acc = 0;
+    unsigned nbits = 0;
+    for(eid_t i = 0; i < deg; i++) {
+        acc |= (uint64_t)(list[i] - base) << nbits;
+        nbits += width;
+        while(nbits >= 8) {
+            *ptr++ = (uint8_t)acc;
+            acc >>= 8;
+            nbits -= 8;
+        }
+    }
+    if(nbits > 0) *ptr++ = (uint8_t)acc;
+    return ptr - out;
+}
+
+/** a view of one adjacency list, either raw `vid_t` values or a bit packed record */
+class adj_list {
+public:
+    const vid_t *raw;
+    const uint8_t *bits;
+    vid_t base;
+    uint64_t mask;
+    uint8_t width;
+    eid_t deg;
+
+    class iterator {
+    public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef vid_t value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const vid_t *pointer;
+        typedef vid_t reference;
+
+        const adj_list *list;
+        eid_t pos;
+
+        iterator(const adj_list *l, eid_t p) : list(l), pos(p) { }
+        vid_t operator*() const { return (*list)[pos]; }
+        vid_t operator[](difference_type n) const { return (*list)[pos + n]; }
+        iterator& operator++() { pos++; return *this; }
+        iterator operator++(int) { iterator it = *this; pos++; return it; }
+        iterator& operator--() { pos--; return *this; }
+        iterator operator--(int) { iterator it = *this; pos--; return it; }
+        iterator& operator+=(difference_type n) { pos += n; return *this; }
+        iterator& operator-=(difference_type n) { pos -= n; return *this; }
+        iterator operator+(difference_type n) const { return iterator(list, pos + n); }
+        iterator operator-(difference_type n) const { return iterator(list, pos - n); }
+        difference_type operator-(const iterator &other) const { return (difference_type)pos - (difference_type)other.pos; }
+        bool operator==(const iterator &other) const { return pos == other.pos; }
+        bool operator!=(const iterator &other) const { return pos != other.pos; }
+        bool operator<(const iterator &other) const { return pos < other.pos; }
+        bool operator>(const iterator &other) const { return pos > other.pos; }
+        bool operator<=(const iterator &other) const { return pos <= other.pos; }
+        bool operator>=(const iterator &other) const { return pos >= other.pos; }
+    };
+
+    adj_list() : raw(NULL), bits(NULL), base(0), mask(0), width(0), deg(0) { }
+
+    adj_list(const vid_t *list, eid_t n) : raw(list), bits(NULL), base(0), mask(0), width(0), deg(n) { }
+
+    /* the view of the bit packed record at `record` */
+    explicit adj_list(const uint8_t *record) : raw(NULL), bits(NULL), base(0), mask(0), width(0), deg(0) {
+        unsigned shift = 0;
+        uint8_t byte;
+        do {
+            byte = *record++;
+            deg |= (eid_t)(byte & 0x7f) << shift;
+            shift += 7;
+        } while(byte & 0x80);
+        if(deg == 0) return;
+        width = *record++;
+        memcpy(&base, record, sizeof(vid_t));
+        bits = record + sizeof(vid_t);
+        mask = (1ULL << width) - 1;
+    }
+
+    vid_t operator[](eid_t i) const {
+        if(raw) return raw[i];
+        uint64_t pos = i * width, word;
+        memcpy(&word, bits + (pos >> 3), sizeof(uint64_t));
+        return base + (vid_t)((word >> (pos & 7)) & mask);
+    }
+
+    eid_t size() const { return deg; }
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(this, deg); }
+};
+
+#endif
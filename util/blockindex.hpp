@@ -0,0 +1,83 @@
+#ifndef _GRAPH_BLOCK_INDEX_H_
+#define _GRAPH_BLOCK_INDEX_H_
+
+#include <vector>
+#include <limits>
+#include "api/types.hpp"
+#include "logger/logger.hpp"
+
+/** block_index
+ *
+ * This file contribute to define the vertex to block index. The vertex range is cut into power of two buckets over
+ * the high bits of the vertex id, at least `BUCKETS_PER_BLOCK` buckets per block, each bucket records the blocks it
+ * overlaps, so a lookup is one table access and a short branchless count over the split points of those blocks:
+ *
+ *   bucket b = v >> shift, blocks [first[b], first[b + 1]], blk = first[b] + #{ p in (first[b], first[b + 1]] : starts[p] <= v }
+ *
+ * The optional packed map stores the block of every vertex in 16 bits, one memory access for each lookup, for the
+ * graphs with less than 65536 blocks.
+ */
+
+#define BUCKETS_PER_BLOCK 4
+
+class block_index {
+private:
+    std::vector<vid_t> starts;      /* the split points, starts[nblocks] is the end of the vertex range */
+    std::vector<bid_t> first;       /* the block holding the first vertex of each bucket */
+    std::vector<uint16_t> vmap;     /* the packed per vertex block map */
+    unsigned shift;
+    bid_t nblocks;
+
+public:
+    block_index() : shift(0), nblocks(0) { }
+
+    /* `vblocks` is the vertex split points of the blocks, the same as the vertex block file */
+    void build(const std::vector<vid_t> &vblocks, bool packed = false) {
+        starts = vblocks;
+        nblocks = starts.size() - 1;
+        vid_t end = starts[nblocks];
+
+        shift = 0;
+        while((end >> shift) > (vid_t)BUCKETS_PER_BLOCK * nblocks) shift++;
+        size_t nbuckets = end == 0 ? 1 : ((end - 1) >> shift) + 1;
+        first.resize(nbuckets + 1);
+        bid_t blk = 0;
+        for(size_t b = 0; b < nbuckets; b++) {
+            vid_t v = (vid_t)(b << shift);
+            while(blk + 1 < nblocks && starts[blk + 1] <= v) blk++;
+            first[b] = blk;
+        }
+        first[nbuckets] = nblocks > 0 ? nblocks - 1 : 0;
+
+        vmap.clear();
+        if(packed && nblocks > std::numeric_limits<uint16_t>::max()) {
+            logstream(LOG_WARNING) << nblocks << " blocks do not fit the packed block map, use the bucket table" << std::endl;
+        } else if(packed) {
+            vmap.resize(end);
+            for(bid_t p = 0; p < nblocks; p++) {
+                for(vid_t v = starts[p]; v < starts[p + 1]; v++) vmap[v] = (uint16_t)p;
+            }
+        }
+    }
+
+    /* the block of vertex `v`, `nblocks` if `v` is out of the vertex range */
+    bid_t get_block(vid_t v) const {
+        if(v >= starts[nblocks]) return nblocks;
+        if(!vmap.empty()) return vmap[v];
+        size_t b = v >> shift;
+        bid_t lo = first[b], hi = first[b + 1], blk = lo;
+        for(bid_t p = lo + 1; p <= hi; p++) blk += starts[p] <= v;
+        return blk;
+    }
+
+    size_t bytes() const { return starts.size() * sizeof(vid_t) + first.size() * sizeof(bid_t) + vmap.size() * sizeof(uint16_t); }
+};
+
+/* the index the walker block fields are derived from, set by the graph blocks */
+const block_index *walker_block_index = NULL;
+
+bid_t walker_block(vid_t v) {
+    return walker_block_index->get_block(v);
+}
+
+#endif
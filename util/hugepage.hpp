@@ -0,0 +1,163 @@
+#ifndef _GRAPH_HUGEPAGE_H_
+#define _GRAPH_HUGEPAGE_H_
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <malloc.h>
+#include <sys/mman.h>
+
+/**
+ * This file defines the huge-page aware allocator used by the cache blocks and the walk buffers, the
+ * random accesses into `beg_pos` and `csr` touch far more pages than the TLB can hold with 4KB pages.
+ *
+ * `HUGEPAGE_NONE`     : malloc, as before
+ * `HUGEPAGE_THP`      : 2MB aligned anonymous mappings advised with MADV_HUGEPAGE (transparent huge pages)
+ * `HUGEPAGE_EXPLICIT` : MAP_HUGETLB mappings from the reserved huge page pool, fall back to `HUGEPAGE_THP`
+ *                       when the pool is exhausted
+ *
+ * The allocations smaller than one huge page always use malloc. `resident_bytes` reads
+ * /proc/self/smaps to tell how much of the huge-page allocations is really backed by huge pages.
+ */
+
+#define HUGE_PAGE_SIZE (2LL * 1024 * 1024)
+
+enum hugepage_mode { HUGEPAGE_NONE = 0, HUGEPAGE_THP, HUGEPAGE_EXPLICIT };
+
+class hugepage_allocator {
+private:
+    std::mutex mtx;
+    std::map<uintptr_t, size_t> regions;    /* the mapped regions, start address -> mapped bytes */
+
+    static size_t round_up(size_t size) {
+        return (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    }
+
+    void *map_explicit(size_t size) {
+#ifdef MAP_HUGETLB
+        void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(ptr != MAP_FAILED) {
+            explicit_bytes += size;
+            return ptr;
+        }
+#endif
+        return NULL;
+    }
+
+    void *map_transparent(size_t size) {
+        /* over map one huge page and trim both ends, so that the region is 2MB aligned */
+        size_t mapped = size + HUGE_PAGE_SIZE;
+        char *raw = static_cast<char *>(mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if(raw == MAP_FAILED) return NULL;
+        uintptr_t addr = reinterpret_cast<uintptr_t>(raw);
+        char *ptr = reinterpret_cast<char *>((addr + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE);
+        if(ptr > raw) munmap(raw, ptr - raw);
+        if(raw + mapped > ptr + size) munmap(ptr + size, raw + mapped - ptr - size);
+#ifdef MADV_HUGEPAGE
+        madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+        return ptr;
+    }
+
+    size_t region_size(void *ptr) {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto iter = regions.find(reinterpret_cast<uintptr_t>(ptr));
+        return iter == regions.end() ? 0 : iter->second;
+    }
+
+public:
+    hugepage_mode mode;
+    size_t alloc_bytes;     /* the bytes currently allocated on the huge page path */
+    size_t explicit_bytes;  /* the bytes ever mapped with MAP_HUGETLB */
+
+    hugepage_allocator() : mode(HUGEPAGE_NONE), alloc_bytes(0), explicit_bytes(0) { }
+
+    void *alloc(size_t size) {
+        if(mode == HUGEPAGE_NONE || size < HUGE_PAGE_SIZE) return malloc(size);
+        size_t mapped = round_up(size);
+        void *ptr = NULL;
+        if(mode == HUGEPAGE_EXPLICIT) ptr = map_explicit(mapped);
+        if(ptr == NULL) ptr = map_transparent(mapped);
+        if(ptr == NULL) return malloc(size);
+
+        std::lock_guard<std::mutex> lock(mtx);
+        regions[reinterpret_cast<uintptr_t>(ptr)] = mapped;
+        alloc_bytes += mapped;
+        return ptr;
+    }
+
+    void free(void *ptr) {
+        if(ptr == NULL) return;
+        size_t mapped = 0;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto iter = regions.find(reinterpret_cast<uintptr_t>(ptr));
+            if(iter != regions.end()) {
+                mapped = iter->second;
+                alloc_bytes -= mapped;
+                regions.erase(iter);
+            }
+        }
+        if(mapped) munmap(ptr, mapped);
+        else ::free(ptr);
+    }
+
+    void *realloc(void *ptr, size_t size) {
+        if(ptr == NULL) return alloc(size);
+        size_t mapped = region_size(ptr);
+        if(mapped >= size) return ptr;
+        if(mapped == 0 && (mode == HUGEPAGE_NONE || size < HUGE_PAGE_SIZE)) return ::realloc(ptr, size);
+
+        size_t old_size = mapped ? mapped : malloc_usable_size(ptr);
+        void *new_ptr = alloc(size);
+        memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+        free(ptr);
+        return new_ptr;
+    }
+
+    /* the bytes of the huge-page allocations which are backed by huge pages */
+    size_t resident_bytes() {
+        std::lock_guard<std::mutex> lock(mtx);
+        FILE *fp = fopen("/proc/self/smaps", "r");
+        if(fp == NULL) return 0;
+        size_t total = 0;
+        bool matched = false;
+        char line[512];
+        while(fgets(line, sizeof(line), fp)) {
+            unsigned long start = 0, end = 0;
+            size_t kbytes = 0;
+            if(sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+                /* a mapping header, the mapping may be merged from several adjacent regions */
+                auto iter = regions.lower_bound(start);
+                matched = (iter != regions.end() && iter->first < end);
+                if(!matched && iter != regions.begin()) {
+                    --iter;
+                    matched = iter->first + iter->second > start;
+                }
+            } else if(matched && (sscanf(line, "AnonHugePages: %zu kB", &kbytes) == 1
+                || sscanf(line, "Private_Hugetlb: %zu kB", &kbytes) == 1 || sscanf(line, "Shared_Hugetlb: %zu kB", &kbytes) == 1)) {
+                total += kbytes * 1024;
+            }
+        }
+        fclose(fp);
+        return total;
+    }
+};
+
+static hugepage_allocator huge_allocator;
+
+inline hugepage_mode parse_hugepage_mode(const std::string &name) {
+    if(name == "thp") return HUGEPAGE_THP;
+    if(name == "hugetlb") return HUGEPAGE_EXPLICIT;
+    return HUGEPAGE_NONE;
+}
+
+inline void *hugepage_alloc(size_t size) { return huge_allocator.alloc(size); }
+inline void *hugepage_realloc(void *ptr, size_t size) { return huge_allocator.realloc(ptr, size); }
+inline void hugepage_free(void *ptr) { huge_allocator.free(ptr); }
+
+#endif
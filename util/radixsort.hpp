@@ -0,0 +1,57 @@
+#ifndef _GRAPH_RADIXSORT_H_
+#define _GRAPH_RADIXSORT_H_
+
+#include <omp.h>
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <algorithm>
+#include <stdint.h>
+
+/**
+ * This file defines the parallel least significant digit radix sort of the walk batches. Each pass counts the
+ * digits of a static slice of the items per thread of the parallel region, so a thread scatters its slice to the
+ * positions of its own counts and the sort is stable.
+ */
+
+#define RADIX_BITS 11
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+/**
+ * sort the `n` items of `data` by the `key_bits` low bits of `key(item)`, `tmp` holds `n` items. the passes go back
+ * and forth between the two arrays, return true if the sorted items end in `tmp`.
+ */
+template<typename T, typename KeyFunc>
+bool parallel_radix_sort(T *data, T *tmp, size_t n, unsigned key_bits, KeyFunc key) {
+    int nthreads = omp_get_max_threads();
+    std::vector<size_t> counts((size_t)nthreads * RADIX_BUCKETS);
+    T *src = data, *dst = tmp;
+    for(unsigned shift = 0; shift < key_bits; shift += RADIX_BITS) {
+        #pragma omp parallel num_threads(nthreads)
+        {
+            /* the region may get fewer threads than requested, e.g. when nested, slice by the threads it got */
+            int t = omp_get_thread_num(), nt = omp_get_num_threads();
+            size_t first = n * t / nt, last = n * (t + 1) / nt;
+            size_t *local = counts.data() + (size_t)t * RADIX_BUCKETS;
+            std::fill(local, local + RADIX_BUCKETS, 0);
+            for(size_t i = first; i < last; i++) local[(key(src[i]) >> shift) & (RADIX_BUCKETS - 1)]++;
+            #pragma omp barrier
+            #pragma omp single
+            {
+                size_t off = 0;
+                for(size_t d = 0; d < RADIX_BUCKETS; d++) {
+                    for(int p = 0; p < nt; p++) {
+                        size_t cnt = counts[(size_t)p * RADIX_BUCKETS + d];
+                        counts[(size_t)p * RADIX_BUCKETS + d] = off;
+                        off += cnt;
+                    }
+                }
+            }
+            for(size_t i = first; i < last; i++) dst[local[(key(src[i]) >> shift) & (RADIX_BUCKETS - 1)]++] = src[i];
+        }
+        std::swap(src, dst);
+    }
+    return src == tmp;
+}
+
+#endif
@@ -2,7 +2,9 @@
 #define _GRAPH_UTIL_H_
 
 #include <string>
+#include <vector>
 #include <sstream>
+#include <algorithm>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/types.h>
@@ -76,10 +78,8 @@ bool test_delete(const std::string & filename) {
 /** given data vertex, return the block that the vertex belongs to */
 bid_t get_block(std::vector<vid_t>& vblocks, vid_t v) {
     bid_t nblocks = vblocks.size() - 1;
-    for(bid_t p = 0; p < nblocks; p++) {
-        if(v < vblocks[p+1]) return p;
-    }
-    return nblocks;
+    if(nblocks == 0 || v >= vblocks[nblocks]) return nblocks;
+    return std::upper_bound(vblocks.begin() + 1, vblocks.end(), v) - vblocks.begin() - 1;
 }
 
 std::string get_path_name(const std::string& s) {
@@ -142,6 +142,12 @@ std::string get_dataset_block_folder(std::string const& base_name, size_t blocks
     return folder;
 }
 
+/** the block folder of the dataset under the storage root `root` */
+std::string get_storage_block_folder(std::string const &root, std::string const &base_name, size_t blocksize)
+{
+    return root + "/" + concatnate_name(get_file_name(base_name) + "_sowalker", blocksize / (1024 * 1024));
+}
+
 std::string get_vert_blocks_name(std::string const &base_name, size_t blocksize)
 {
     std::string folder = get_dataset_block_folder(base_name, blocksize), dataset_name = get_file_name(base_name);
@@ -162,12 +168,38 @@ std::string get_walk_name(std::string const &base_name, size_t blocksize, bid_t
     return folder + "/" + walk_name;
 }
 
+std::string get_checkpoint_name(std::string const &base_name, size_t blocksize)
+{
+    std::string folder = get_dataset_block_folder(base_name, blocksize);
+    return folder + "/walks.ckpt";
+}
+
+/** the resident blocks at the exit of the last run, preloaded by the next run */
+std::string get_cache_snapshot_name(std::string const &base_name, size_t blocksize)
+{
+    std::string folder = get_dataset_block_folder(base_name, blocksize);
+    return folder + "/cache.snapshot";
+}
+
+std::string get_trajectory_name(std::string const &base_name, size_t blocksize, tid_t tid)
+{
+    std::string folder = get_dataset_block_folder(base_name, blocksize);
+    return folder + "/" + std::to_string(tid) + ".traj";
+}
+
 std::string get_expected_walk_length_name(std::string const & base_name, size_t blocksize) {
     std::string folder = get_dataset_block_folder(base_name, blocksize), dataset_name = get_file_name(base_name);
     dataset_name += ".exp";
     return folder + "/" + dataset_name;
 }
 
+/** the bit packed bytes of each block, see `util/bitpack.hpp` */
+std::string get_packed_blocks_name(std::string const & base_name, size_t blocksize) {
+    std::string folder = get_dataset_block_folder(base_name, blocksize), dataset_name = get_file_name(base_name);
+    dataset_name = concatnate_name(dataset_name, blocksize / (1024 * 1024)) + "MB.packed.blocks";
+    return folder + "/" + dataset_name;
+}
+
 bool test_dataset_processed_exists(std::string const &base_name) {
     std::string beg_pos_name = get_beg_pos_name(base_name);
     std::string csr_name = get_csr_name(base_name);
@@ -281,4 +313,16 @@ public:
     int iRand(int min, int max) { return lRand() % (max - min) + min; }
 };
 
+/**
+ * the `counter`-th value of the random stream `seed`, the splitmix64 hash of the counter. the values are drawn in
+ * any order by any thread without a shared state, so a parallel loop draws the same values at any thread count.
+ */
+inline uint64_t counter_rand(uint64_t seed, uint64_t counter)
+{
+    uint64_t z = seed + (counter + 1) * UINT64_C(0x9E3779B97F4A7C15);
+    z = (z ^ z >> 30) * UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ z >> 27) * UINT64_C(0x94D049BB133111EB);
+    return z ^ (z >> 31);
+}
+
 #endif